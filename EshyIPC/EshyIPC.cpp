@@ -7,10 +7,77 @@
 #include <sys/types.h>
 #include <sys/ipc.h>
 #include <sys/shm.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <climits>
+#include <unistd.h>
 #include <map>
+#include <deque>
+#include <new>
+#include <algorithm>
 
 static std::map<int, eipcSharedMemory> SharedMemories;
 
+//Messages that did not fit in the ring yet, kept in order per block and direction
+static std::map<int, std::deque<std::string>> PendingMessages[EIPC_NUM_DIRECTIONS];
+
+static size_t RoundSharedMemorySize(size_t Size)
+{
+    //Big blocks are padded to whole huge pages so transparent huge pages can back them
+    const size_t Alignment = Size >= EIPC_HUGE_PAGE_SIZE ? EIPC_HUGE_PAGE_SIZE : (size_t)sysconf(_SC_PAGESIZE);
+    return (Size + Alignment - 1) / Alignment * Alignment;
+}
+
+static void AdviseHugePages(eipcSharedMemory& SharedMemory)
+{
+    if (SharedMemory.Size >= EIPC_HUGE_PAGE_SIZE)
+        madvise(SharedMemory.Block, SharedMemory.Size, MADV_HUGEPAGE);
+}
+
+static eipcSharedSegment* GetSegment(int id)
+{
+    return (eipcSharedSegment*)SharedMemories[id].Block;
+}
+
+static void Publish(int id, eipcSharedSegment* Segment, eipcDirection Direction)
+{
+    Segment->Header.Generations[Direction].Value.fetch_add(1, std::memory_order_release);
+
+    if (const int fd = SharedMemories[id].NotifyFds[Direction]; fd >= 0)
+        eventfd_write(fd, 1);
+}
+
+static eipcBroadcastRing* GetBroadcastRing(int id)
+{
+    return (eipcBroadcastRing*)SharedMemories[id].Block;
+}
+
+//Shared (not private) futex operations since the word lives in memory mapped by several processes
+static long Futex(std::atomic<uint32_t>& Word, int Operation, uint32_t Value, const struct timespec* Timeout)
+{
+    return syscall(SYS_futex, (uint32_t*)&Word, Operation, Value, Timeout, NULL, 0);
+}
+
+static bool TryPushMessage(eipcRing& Ring, const void* Data, uint32_t Size)
+{
+    const uint32_t Head = Ring.Head.load(std::memory_order_relaxed);
+    if (Head - Ring.Tail.load(std::memory_order_acquire) == EIPC_RING_CAPACITY)
+        return false;
+
+    eipcRingSlot& Slot = Ring.Slots[Head & (EIPC_RING_CAPACITY - 1)];
+    memcpy(Slot.Data, Data, Size);
+    Slot.Size = Size;
+
+    //Publish the slot only after its contents are written
+    Ring.Head.store(Head + 1, std::memory_order_release);
+    return true;
+}
+
 namespace EshyIPC
 {
 int MakeSharedMemoryBlock(const std::string& Filename, int Size)
@@ -21,36 +88,363 @@ int MakeSharedMemoryBlock(const std::string& Filename, int Size)
 
     key_t key = ftok(Filename.c_str(), SharedMemories.size());
 
-    eipcSharedMemory SharedMemory = {nullptr, Size};
+    eipcSharedMemory SharedMemory;
+    SharedMemory.Size = Size;
     int id = shmget(key, Size, 0644 | IPC_CREAT);
     SharedMemories.emplace(id, SharedMemory);
     return id;
 }
 
+int MakeSharedMemoryFd(const std::string& Name, size_t Size)
+{
+    const int fd = memfd_create(Name.c_str(), MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    Size = RoundSharedMemorySize(Size);
+
+    //Readers may rely on the block never shrinking under them, and nobody else may change that. Growing stays allowed
+    if (ftruncate(fd, Size) < 0 || fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    eipcSharedMemory SharedMemory;
+    SharedMemory.Size = Size;
+    SharedMemory.Backend = EIPC_BACKEND_MEMFD;
+    SharedMemories[fd] = SharedMemory;
+    return fd;
+}
+
 eipcSharedMemory& AttachSharedMemoryBlock(int id)
 {
-    SharedMemories[id].Block = (char*)shmat(id, NULL, 0);
-    return SharedMemories[id];
+    eipcSharedMemory& SharedMemory = SharedMemories[id];
+    if (SharedMemory.AttachCount++ > 0)
+        return SharedMemory;
+
+    void* Block;
+    if (SharedMemory.Backend == EIPC_BACKEND_MEMFD)
+        Block = mmap(NULL, SharedMemory.Size, PROT_READ | PROT_WRITE, MAP_SHARED, id, 0);
+    else
+        Block = shmat(id, NULL, 0);
+
+    //Both report failure as (void*)-1, leave the block unattached so the caller sees a null Block and a later attach can retry
+    if (Block == MAP_FAILED)
+    {
+        SharedMemory.Block = nullptr;
+        SharedMemory.AttachCount = 0;
+        return SharedMemory;
+    }
+
+    SharedMemory.Block = (char*)Block;
+    if (SharedMemory.Backend == EIPC_BACKEND_MEMFD)
+        AdviseHugePages(SharedMemory);
+
+    return SharedMemory;
 }
 
 void DetachSharedMemoryBlock(int id)
 {
-    shmdt(SharedMemories[id].Block);
+    eipcSharedMemory& SharedMemory = SharedMemories[id];
+    if (SharedMemory.AttachCount > 0 && --SharedMemory.AttachCount == 0)
+    {
+        if (SharedMemory.Backend == EIPC_BACKEND_MEMFD)
+            munmap(SharedMemory.Block, SharedMemory.Size);
+        else
+            shmdt(SharedMemory.Block);
+
+        SharedMemory.Block = nullptr;
+    }
 }
 
 void DestroySharedMemoryBlock(int id)
 {
-    shmctl(id, IPC_RMID, NULL);
+    //Memfd blocks go away with their last fd and mapping
+    if (SharedMemories[id].Backend == EIPC_BACKEND_MEMFD)
+        close(id);
+    else
+        shmctl(id, IPC_RMID, NULL);
+
     SharedMemories.erase(id);
+
+    for (int i = 0; i < EIPC_NUM_DIRECTIONS; ++i)
+        PendingMessages[i].erase(id);
+}
+
+bool ResizeSharedMemoryBlock(int id, size_t NewSize)
+{
+    eipcSharedMemory& SharedMemory = SharedMemories[id];
+    if (SharedMemory.Backend != EIPC_BACKEND_MEMFD)
+        return false;
+
+    NewSize = (NewSize + EIPC_HUGE_PAGE_SIZE - 1) / EIPC_HUGE_PAGE_SIZE * EIPC_HUGE_PAGE_SIZE;
+    if (NewSize <= SharedMemory.Size)
+        return true;
+
+    if (ftruncate(id, NewSize) < 0)
+        return false;
+
+    if (!SharedMemory.Block)
+    {
+        SharedMemory.Size = NewSize;
+        return true;
+    }
+
+    void* Block = mremap(SharedMemory.Block, SharedMemory.Size, NewSize, MREMAP_MAYMOVE);
+    if (Block == MAP_FAILED)
+        return false;
+
+    SharedMemory.Block = (char*)Block;
+    SharedMemory.Size = NewSize;
+    AdviseHugePages(SharedMemory);
+    return true;
+}
+
+bool RefreshSharedMemoryBlock(int id)
+{
+    eipcSharedMemory& SharedMemory = SharedMemories[id];
+    struct stat Stat;
+    if (SharedMemory.Backend != EIPC_BACKEND_MEMFD || fstat(id, &Stat) < 0 || (size_t)Stat.st_size <= SharedMemory.Size)
+        return false;
+
+    if (SharedMemory.Block)
+    {
+        void* Block = mremap(SharedMemory.Block, SharedMemory.Size, Stat.st_size, MREMAP_MAYMOVE);
+        if (Block == MAP_FAILED)
+            return false;
+
+        SharedMemory.Block = (char*)Block;
+    }
+
+    SharedMemory.Size = Stat.st_size;
+    AdviseHugePages(SharedMemory);
+    return true;
+}
+
+std::string GetSharedMemoryToken(int id)
+{
+    return (SharedMemories[id].Backend == EIPC_BACKEND_MEMFD ? "memfd:" : "sysv:") + std::to_string(id);
+}
+
+int OpenSharedMemoryToken(const std::string& Token)
+{
+    const size_t Separator = Token.find(':');
+    const std::string Kind = Separator == std::string::npos ? "sysv" : Token.substr(0, Separator);
+    const int id = atoi(Token.c_str() + (Separator == std::string::npos ? 0 : Separator + 1));
+
+    if (Kind == "memfd")
+    {
+        struct stat Stat;
+        if (fstat(id, &Stat) < 0)
+            return -1;
+
+        SharedMemories[id].Backend = EIPC_BACKEND_MEMFD;
+        SharedMemories[id].Size = Stat.st_size;
+    }
+
+    return id;
+}
+
+void InitializeSegment(int id)
+{
+    new (SharedMemories[id].Block) eipcSharedSegment();
 }
 
-void InsertIntoMemory(int id, const std::string& Data)
+bool SendMessage(int id, eipcDirection Direction, const void* Data, uint32_t Size)
 {
-    strncpy(SharedMemories[id].Block, Data.c_str(), SharedMemories[id].Size);
+    if (Size > sizeof(eipcRingSlot::Data))
+        return false;
+
+    //Anything already waiting must go first to keep ordering
+    FlushMessages(id, Direction);
+
+    eipcSharedSegment* Segment = GetSegment(id);
+    std::deque<std::string>& Pending = PendingMessages[Direction][id];
+    if (!Pending.empty() || !TryPushMessage(Segment->Rings[Direction], Data, Size))
+        Pending.emplace_back((const char*)Data, Size);
+    else
+        Publish(id, Segment, Direction);
+
+    return true;
+}
+
+bool ReceiveMessage(int id, eipcDirection Direction, void* OutData, uint32_t MaxSize, uint32_t& OutSize)
+{
+    eipcRing& Ring = GetSegment(id)->Rings[Direction];
+
+    const uint32_t Tail = Ring.Tail.load(std::memory_order_relaxed);
+    if (Tail == Ring.Head.load(std::memory_order_acquire))
+        return false;
+
+    const eipcRingSlot& Slot = Ring.Slots[Tail & (EIPC_RING_CAPACITY - 1)];
+    OutSize = Slot.Size;
+    memcpy(OutData, Slot.Data, std::min(Slot.Size, MaxSize));
+
+    //Any push that failed saw the ring full, so freeing a slot of a full ring is the moment the producer can retry its backlog
+    const bool bWasFull = Ring.Head.load(std::memory_order_relaxed) - Tail == EIPC_RING_CAPACITY;
+
+    //Hand the slot back to the producer only after it was copied out
+    Ring.Tail.store(Tail + 1, std::memory_order_release);
+
+    //The producer sleeps on the notifier of the other direction
+    if (const int fd = SharedMemories[id].NotifyFds[1 - Direction]; bWasFull && fd >= 0)
+        eventfd_write(fd, 1);
+
+    return true;
+}
+
+void FlushMessages(int id, eipcDirection Direction)
+{
+    auto it = PendingMessages[Direction].find(id);
+    if (it == PendingMessages[Direction].end() || it->second.empty())
+        return;
+
+    eipcSharedSegment* Segment = GetSegment(id);
+    bool bPublished = false;
+    while (!it->second.empty() && TryPushMessage(Segment->Rings[Direction], it->second.front().data(), it->second.front().size()))
+    {
+        it->second.pop_front();
+        bPublished = true;
+    }
+
+    if (bPublished)
+        Publish(id, Segment, Direction);
+}
+
+bool HasPendingMessages(int id, eipcDirection Direction)
+{
+    auto it = PendingMessages[Direction].find(id);
+    return it != PendingMessages[Direction].end() && !it->second.empty();
+}
+
+bool HasNewMessages(int id, eipcDirection Direction, uint64_t& LastGeneration)
+{
+    const uint64_t Generation = GetSegment(id)->Header.Generations[Direction].Value.load(std::memory_order_acquire);
+    if (Generation == LastGeneration)
+        return false;
+
+    LastGeneration = Generation;
+    return true;
+}
+
+int MakeNotifier()
+{
+    return eventfd(0, EFD_NONBLOCK);
+}
+
+void SetNotifier(int id, eipcDirection Direction, int fd)
+{
+    SharedMemories[id].NotifyFds[Direction] = fd;
+}
+
+int GetNotifier(int id, eipcDirection Direction)
+{
+    return SharedMemories[id].NotifyFds[Direction];
 }
 
-void InsertIntoMemoryUnprotected(int id, const std::string& Data)
+void ClearNotifier(int fd)
 {
-    strcpy(SharedMemories[id].Block, Data.c_str());
+    eventfd_t Value;
+    eventfd_read(fd, &Value);
+}
+
+bool WaitForNotifier(int fd, int TimeoutMs)
+{
+    struct pollfd PollFd = {fd, POLLIN, 0};
+    if (poll(&PollFd, 1, TimeoutMs) <= 0)
+        return false;
+
+    ClearNotifier(fd);
+    return true;
+}
+
+void InitializeBroadcast(int id)
+{
+    new (SharedMemories[id].Block) eipcBroadcastRing();
+}
+
+bool BroadcastMessage(int id, const void* Data, uint32_t Size)
+{
+    if (Size > sizeof(eipcBroadcastSlot::Data))
+        return false;
+
+    eipcBroadcastRing* Ring = GetBroadcastRing(id);
+    const uint64_t Head = Ring->Head.load(std::memory_order_relaxed);
+    eipcBroadcastSlot& Slot = Ring->Slots[Head & (EIPC_BROADCAST_CAPACITY - 1)];
+
+    //Mark the slot as being rewritten so a reader copying it at the same time throws its copy away
+    Slot.Sequence.store(2 * Head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(Slot.Data, Data, Size);
+    Slot.Size = Size;
+    Slot.Sequence.store(2 * (Head + 1), std::memory_order_release);
+    Ring->Head.store(Head + 1, std::memory_order_release);
+
+    //Only pay for the syscall when someone is actually asleep
+    Ring->WakeWord.fetch_add(1);
+    if (Ring->Waiters.load() > 0)
+        Futex(Ring->WakeWord, FUTEX_WAKE, INT_MAX, NULL);
+
+    return true;
+}
+
+uint64_t GetBroadcastHead(int id)
+{
+    return GetBroadcastRing(id)->Head.load(std::memory_order_acquire);
+}
+
+eipcReceiveResult ReceiveBroadcast(int id, uint64_t& Cursor, void* OutData, uint32_t MaxSize, uint32_t& OutSize)
+{
+    eipcBroadcastRing* Ring = GetBroadcastRing(id);
+    const uint64_t Head = Ring->Head.load(std::memory_order_acquire);
+    if (Cursor == Head)
+        return EIPC_RECEIVE_EMPTY;
+
+    if (Head - Cursor > EIPC_BROADCAST_CAPACITY || Cursor > Head)
+    {
+        Cursor = Head;
+        return EIPC_RECEIVE_OVERRUN;
+    }
+
+    const eipcBroadcastSlot& Slot = Ring->Slots[Cursor & (EIPC_BROADCAST_CAPACITY - 1)];
+    const uint64_t Expected = 2 * (Cursor + 1);
+    if (Slot.Sequence.load(std::memory_order_acquire) != Expected)
+    {
+        Cursor = Ring->Head.load(std::memory_order_acquire);
+        return EIPC_RECEIVE_OVERRUN;
+    }
+
+    const uint32_t Size = std::min(Slot.Size, (uint32_t)sizeof(eipcBroadcastSlot::Data));
+    memcpy(OutData, Slot.Data, std::min(Size, MaxSize));
+
+    //The writer may have lapped us while copying
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (Slot.Sequence.load(std::memory_order_relaxed) != Expected)
+    {
+        Cursor = Ring->Head.load(std::memory_order_acquire);
+        return EIPC_RECEIVE_OVERRUN;
+    }
+
+    OutSize = Size;
+    Cursor++;
+    return EIPC_RECEIVE_OK;
+}
+
+bool WaitForBroadcast(int id, uint64_t Cursor, int TimeoutMs)
+{
+    eipcBroadcastRing* Ring = GetBroadcastRing(id);
+
+    //Read the wake word before checking the head, a publish in between changes the word and the futex wait returns straight away
+    const uint32_t WakeWord = Ring->WakeWord.load();
+    if (Ring->Head.load(std::memory_order_acquire) != Cursor)
+        return true;
+
+    struct timespec Timeout = {TimeoutMs / 1000, (TimeoutMs % 1000) * 1000000L};
+    Ring->Waiters.fetch_add(1);
+    Futex(Ring->WakeWord, FUTEX_WAIT, WakeWord, TimeoutMs < 0 ? NULL : &Timeout);
+    Ring->Waiters.fetch_sub(1);
+
+    return Ring->Head.load(std::memory_order_acquire) != Cursor;
+}
 }
-}
\ No newline at end of file
@@ -1,21 +1,551 @@
-
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+#define EIPC_CACHE_LINE_SIZE        64
+#define EIPC_RING_CAPACITY          64      //Must be a power of two
+#define EIPC_RING_SLOT_SIZE         1024
+#define EIPC_HUGE_PAGE_SIZE         (2 * 1024 * 1024)
+#define EIPC_BROADCAST_CAPACITY     256     //Must be a power of two
+#define EIPC_BROADCAST_SLOT_SIZE    1024
+
+enum eipcBackend
+{
+    EIPC_BACKEND_SYSV,
+    EIPC_BACKEND_MEMFD
+};
+
+enum eipcDirection
+{
+    EIPC_TO_CLIENT,
+    EIPC_TO_COMPOSITOR,
+    EIPC_NUM_DIRECTIONS
+};
+
+struct eipcRingSlot
+{
+    uint32_t Size;
+    char Data[EIPC_RING_SLOT_SIZE - sizeof(uint32_t)];
+};
+
+//Single-producer/single-consumer ring. Head is only written by the producer and Tail only by the consumer, both are free running and wrap naturally
+struct eipcRing
+{
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint32_t> Head;
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint32_t> Tail;
+    alignas(EIPC_CACHE_LINE_SIZE) eipcRingSlot Slots[EIPC_RING_CAPACITY];
+};
+
+struct eipcGenerationCounter
+{
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint64_t> Value;
+};
+
+//Bumped by the producer after every publish so readers can tell nothing changed with a single load
+struct eipcSegmentHeader
+{
+    eipcGenerationCounter Generations[EIPC_NUM_DIRECTIONS];
+};
+
+//Layout of a shared memory block used for messaging, one ring per direction
+struct eipcSharedSegment
+{
+    eipcSegmentHeader Header;
+    eipcRing Rings[EIPC_NUM_DIRECTIONS];
+};
+
+enum eipcReceiveResult
+{
+    EIPC_RECEIVE_EMPTY,
+    EIPC_RECEIVE_OK,
+    //The writer lapped this reader and messages were lost. The cursor was moved to the newest message, the reader must resync its state
+    EIPC_RECEIVE_OVERRUN
+};
+
+//Sequence is 2 * (n + 1) once message n is fully written to the slot and odd while the writer is filling it
+struct eipcBroadcastSlot
+{
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint64_t> Sequence;
+    uint32_t Size;
+    char Data[EIPC_BROADCAST_SLOT_SIZE - sizeof(uint64_t) - sizeof(uint32_t)];
+};
+
+/*Single-producer/multi-consumer ring. The producer never waits for readers, each reader keeps its own cursor in its own process and
+*  finds out it was overrun from the slot sequence. Waiting readers sleep on a futex on WakeWord so one wake covers all of them*/
+struct eipcBroadcastRing
+{
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint64_t> Head;
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint32_t> WakeWord;
+    std::atomic<uint32_t> Waiters;
+    alignas(EIPC_CACHE_LINE_SIZE) eipcBroadcastSlot Slots[EIPC_BROADCAST_CAPACITY];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Ring indices must be lock free to be shared between processes");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Generation counters must be lock free to be shared between processes");
+static_assert((EIPC_RING_CAPACITY & (EIPC_RING_CAPACITY - 1)) == 0, "Ring capacity must be a power of two");
+static_assert((EIPC_BROADCAST_CAPACITY & (EIPC_BROADCAST_CAPACITY - 1)) == 0, "Broadcast capacity must be a power of two");
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "Futex words must be plain 32-bit integers");
+
+/*Versioned table of records with a log of the most recent changes, for one writer and any number of readers. A sequence number guards
+*  the whole region, it is odd while the writer is mid update. Records must have a uint64_t ID member. The table starts with room for
+*  InitialRecords and runs past the end of the struct once the writer grows a memfd block, see Capacity*/
+template<class Record, uint32_t InitialRecords, uint32_t DeltaCapacity>
+struct eipcSnapshotRegion
+{
+    static_assert(std::is_trivially_copyable_v<Record>, "Snapshot records are copied as raw bytes");
+    static_assert((DeltaCapacity & (DeltaCapacity - 1)) == 0, "Delta capacity must be a power of two");
+
+    using RecordType = Record;
+    static constexpr uint32_t LogCapacity = DeltaCapacity;
+
+    //Bytes a block needs for a table of Capacity records
+    static size_t GetSize(uint32_t Capacity)
+    {
+        return sizeof(eipcSnapshotRegion) + (size_t)(std::max(Capacity, InitialRecords) - InitialRecords) * sizeof(Record);
+    }
+
+    //Records that fit in a block of Size bytes
+    static uint32_t GetCapacity(size_t Size)
+    {
+        return InitialRecords + (uint32_t)((Size - std::min(Size, sizeof(eipcSnapshotRegion))) / sizeof(Record));
+    }
+
+    struct Delta
+    {
+        uint64_t Version;
+        uint32_t bRemoved;
+        Record Data;
+    };
+
+    alignas(EIPC_CACHE_LINE_SIZE) std::atomic<uint64_t> Sequence;
+    alignas(EIPC_CACHE_LINE_SIZE) uint64_t Version;
+    uint32_t Count;
+    //Records the block has room for. Only ever grows, a reader that mapped less remaps before reading records past what it has
+    uint32_t Capacity;
+    //The change that produced version V lives at Deltas[V % DeltaCapacity]
+    Delta Deltas[DeltaCapacity];
+    //Last so growing the block only adds room at the end of the table
+    Record Records[InitialRecords];
+};
 
 struct eipcSharedMemory
 {
-    char* Block;
-    int Size;
+    char* Block = nullptr;
+    size_t Size = 0;
+    int AttachCount = 0;
+    eipcBackend Backend = EIPC_BACKEND_SYSV;
+    //Eventfds signalled after publishing in each direction, -1 if unused
+    int NotifyFds[EIPC_NUM_DIRECTIONS] = {-1, -1};
 };
 
 namespace EshyIPC
 {
+//SysV block keyed off a file in the working directory, kept as a fallback for systems without memfd
 int MakeSharedMemoryBlock(const std::string& Filename, int Size);
+/*Anonymous memfd block sealed against shrinking, returns -1 on failure. The id is the fd itself, which is not close-on-exec
+*  so spawned helpers inherit it. Large sizes are rounded up to whole huge pages*/
+int MakeSharedMemoryFd(const std::string& Name, size_t Size);
+//Maps the block on first use and returns the cached mapping afterwards, each attach must be paired with a detach. Block is null if mapping failed
 eipcSharedMemory& AttachSharedMemoryBlock(int id);
 void DetachSharedMemoryBlock(int id);
 void DestroySharedMemoryBlock(int id);
 
-void InsertIntoMemory(int id, const std::string& Data);
-void InsertIntoMemoryUnprotected(int id, const std::string& Data);
-}
\ No newline at end of file
+/*Grows a memfd block, keeping its contents. Grown blocks are padded to whole huge pages since only large payloads outgrow their
+*  first size. Every other process that has the block attached must call RefreshSharedMemoryBlock before touching the new part*/
+bool ResizeSharedMemoryBlock(int id, size_t NewSize);
+//Remaps a memfd block if another process grew it. Returns true if the mapping changed
+bool RefreshSharedMemoryBlock(int id);
+
+//Describes a block so another process can find it, e.g. "memfd:5" or "sysv:32769"
+std::string GetSharedMemoryToken(int id);
+//Registers the block named by a token from GetSharedMemoryToken and returns its id. A plain number is treated as a SysV id
+int OpenSharedMemoryToken(const std::string& Token);
+
+//Must be called once by the creator of the block after attaching it
+void InitializeSegment(int id);
+
+//Queues the message locally if the ring is full, it is delivered by a later SendMessage or FlushMessages, e.g. once the notifier says the reader made room. Returns false if the message does not fit in a slot
+bool SendMessage(int id, eipcDirection Direction, const void* Data, uint32_t Size);
+//Copies at most MaxSize bytes of the oldest message into OutData and reports its full size in OutSize
+bool ReceiveMessage(int id, eipcDirection Direction, void* OutData, uint32_t MaxSize, uint32_t& OutSize);
+//Returns true and updates LastGeneration if anything was published in this direction since LastGeneration was taken
+bool HasNewMessages(int id, eipcDirection Direction, uint64_t& LastGeneration);
+void FlushMessages(int id, eipcDirection Direction);
+//True while messages queued by SendMessage are still waiting for room in the ring
+bool HasPendingMessages(int id, eipcDirection Direction);
+
+/*Notifiers are eventfds that become readable whenever a message is published in their direction, or when the reader of the other
+*  direction frees a slot in a full ring so queued messages can be flushed. They are not close-on-exec so spawned clients inherit them*/
+int MakeNotifier();
+void SetNotifier(int id, eipcDirection Direction, int fd);
+int GetNotifier(int id, eipcDirection Direction);
+void ClearNotifier(int fd);
+//Blocks until the notifier fires or the timeout (in milliseconds, -1 for none) expires, clearing it if it fired
+bool WaitForNotifier(int fd, int TimeoutMs);
+
+//Must be called once by the creator of a broadcast block after attaching it
+void InitializeBroadcast(int id);
+//Publishes one message to every reader and wakes any that are waiting. Returns false if the message does not fit in a slot
+bool BroadcastMessage(int id, const void* Data, uint32_t Size);
+//Number of messages published so far, a new reader starts its cursor here to only see what comes next
+uint64_t GetBroadcastHead(int id);
+//Copies the message at Cursor and advances it, see eipcReceiveResult for what happens to readers that fell behind
+eipcReceiveResult ReceiveBroadcast(int id, uint64_t& Cursor, void* OutData, uint32_t MaxSize, uint32_t& OutSize);
+//Blocks until a message past Cursor is published or the timeout (in milliseconds, -1 for none) expires. Returns true if one is available
+bool WaitForBroadcast(int id, uint64_t Cursor, int TimeoutMs);
+
+inline bool SendMessage(int id, eipcDirection Direction, const std::string& Data)
+{
+    return SendMessage(id, Direction, Data.data(), Data.size());
+}
+
+inline bool ReceiveMessage(int id, eipcDirection Direction, std::string& OutData)
+{
+    char Buffer[sizeof(eipcRingSlot::Data)];
+    uint32_t Size;
+    if (!ReceiveMessage(id, Direction, Buffer, sizeof(Buffer), Size))
+        return false;
+
+    OutData.assign(Buffer, Size);
+    return true;
+}
+
+//Typed view over one direction of a block. Messages are copied straight into ring slots, so they must be trivially copyable and fit in a slot
+template<class Message>
+class Channel
+{
+    static_assert(std::is_trivially_copyable_v<Message>, "Channel messages are copied as raw bytes");
+    static_assert(sizeof(Message) <= sizeof(eipcRingSlot::Data), "Channel messages must fit in a single ring slot");
+
+public:
+
+    Channel()
+        : id(-1)
+        , Direction(EIPC_TO_CLIENT)
+        , LastGeneration(0)
+    {}
+
+    void Open(int _id, eipcDirection _Direction)
+    {
+        id = _id;
+        Direction = _Direction;
+        LastGeneration = 0;
+    }
+
+    bool IsOpen() const {return id >= 0;}
+
+    bool Send(const Message& Data) {return SendMessage(id, Direction, &Data, sizeof(Message));}
+
+    bool Receive(Message& OutData)
+    {
+        uint32_t Size;
+        return ReceiveMessage(id, Direction, &OutData, sizeof(Message), Size) && Size == sizeof(Message);
+    }
+
+    bool HasNewMessages() {return EshyIPC::HasNewMessages(id, Direction, LastGeneration);}
+    void Flush() {FlushMessages(id, Direction);}
+
+private:
+
+    int id;
+    eipcDirection Direction;
+    uint64_t LastGeneration;
+};
+
+//Typed view over a broadcast block. The process that created the block sends, any number of others receive with their own cursor
+template<class Message>
+class BroadcastChannel
+{
+    static_assert(std::is_trivially_copyable_v<Message>, "Broadcast messages are copied as raw bytes");
+    static_assert(sizeof(Message) <= sizeof(eipcBroadcastSlot::Data), "Broadcast messages must fit in a single slot");
+
+public:
+
+    BroadcastChannel()
+        : id(-1)
+        , Cursor(0)
+    {}
+
+    //Readers start at the current head and only see messages published after they opened
+    void Open(int _id)
+    {
+        id = _id;
+        Cursor = GetBroadcastHead(id);
+    }
+
+    bool IsOpen() const {return id >= 0;}
+
+    bool Send(const Message& Data) {return BroadcastMessage(id, &Data, sizeof(Message));}
+
+    eipcReceiveResult Receive(Message& OutData)
+    {
+        uint32_t Size;
+        const eipcReceiveResult Result = ReceiveBroadcast(id, Cursor, &OutData, sizeof(Message), Size);
+        return Result == EIPC_RECEIVE_OK && Size != sizeof(Message) ? EIPC_RECEIVE_OVERRUN : Result;
+    }
+
+    bool Wait(int TimeoutMs) {return WaitForBroadcast(id, Cursor, TimeoutMs);}
+
+private:
+
+    int id;
+    uint64_t Cursor;
+};
+
+template<class Region>
+class SnapshotWriter
+{
+public:
+
+    using Record = typename Region::RecordType;
+
+    SnapshotWriter()
+        : id(-1)
+        , Memory(nullptr)
+    {}
+
+    //Attaches the block, takes ownership of the region and clears it. Returns false if the block could not be mapped
+    bool Open(int _id)
+    {
+        Memory = &AttachSharedMemoryBlock(_id);
+        if (!Memory->Block)
+        {
+            Memory = nullptr;
+            return false;
+        }
+
+        id = _id;
+        new (Memory->Block) Region();
+        GetRegion()->Capacity = Region::GetCapacity(Memory->Size);
+        Index.clear();
+        return true;
+    }
+
+    void Close()
+    {
+        if (Memory)
+            DetachSharedMemoryBlock(id);
+
+        Memory = nullptr;
+    }
+
+    bool IsOpen() const {return Memory;}
+    uint32_t GetCapacity() const {return GetRegion()->Capacity;}
+
+    //Adds the record or replaces the one with the same ID, growing the table when it is full. Returns false if it could not grow
+    bool Upsert(const Record& Data)
+    {
+        auto it = Index.find(Data.ID);
+        if (it == Index.end() && GetRegion()->Count == GetRegion()->Capacity && !Grow())
+            return false;
+
+        Region* Snapshot = GetRegion();
+        BeginWrite();
+        if (it == Index.end())
+        {
+            Index.emplace(Data.ID, Snapshot->Count);
+            Snapshot->Records[Snapshot->Count++] = Data;
+        }
+        else
+            Snapshot->Records[it->second] = Data;
+
+        AppendDelta(false, Data);
+        EndWrite();
+        return true;
+    }
+
+    void Remove(uint64_t ID)
+    {
+        auto it = Index.find(ID);
+        if (it == Index.end())
+            return;
+
+        Region* Snapshot = GetRegion();
+        BeginWrite();
+        const Record Removed = Snapshot->Records[it->second];
+
+        //Keep the table dense by moving the last record into the hole
+        const uint32_t Last = --Snapshot->Count;
+        if (it->second != Last)
+        {
+            Snapshot->Records[it->second] = Snapshot->Records[Last];
+            Index[Snapshot->Records[it->second].ID] = it->second;
+        }
+
+        Index.erase(it);
+        AppendDelta(true, Removed);
+        EndWrite();
+    }
+
+private:
+
+    //The mapping moves when the block grows, so it is looked up every time
+    Region* GetRegion() const {return (Region*)Memory->Block;}
+
+    //Doubles the table. Existing records and the log stay where they are, readers see the new capacity and map the rest
+    bool Grow()
+    {
+        if (!ResizeSharedMemoryBlock(id, Region::GetSize(GetRegion()->Capacity * 2)))
+            return false;
+
+        BeginWrite();
+        GetRegion()->Capacity = Region::GetCapacity(Memory->Size);
+        EndWrite();
+        return true;
+    }
+
+    void BeginWrite()
+    {
+        Region* Snapshot = GetRegion();
+        Snapshot->Sequence.store(Snapshot->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void EndWrite()
+    {
+        Region* Snapshot = GetRegion();
+        Snapshot->Sequence.store(Snapshot->Sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    void AppendDelta(bool bRemoved, const Record& Data)
+    {
+        Region* Snapshot = GetRegion();
+        const uint64_t Version = ++Snapshot->Version;
+        typename Region::Delta& Delta = Snapshot->Deltas[Version & (Region::LogCapacity - 1)];
+        Delta.Version = Version;
+        Delta.bRemoved = bRemoved;
+        Delta.Data = Data;
+    }
+
+    int id;
+    eipcSharedMemory* Memory;
+    std::unordered_map<uint64_t, uint32_t> Index;
+};
+
+template<class Region>
+class SnapshotReader
+{
+public:
+
+    using Record = typename Region::RecordType;
+
+    SnapshotReader()
+        : id(-1)
+        , Memory(nullptr)
+        , Version(0)
+        , LastSequence(0)
+        , bSynced(false)
+    {}
+
+    //Attaches the block, returns false if it could not be mapped
+    bool Open(int _id)
+    {
+        Memory = &AttachSharedMemoryBlock(_id);
+        if (!Memory->Block)
+        {
+            Memory = nullptr;
+            return false;
+        }
+
+        id = _id;
+        bSynced = false;
+        return true;
+    }
+
+    void Close()
+    {
+        if (Memory)
+            DetachSharedMemoryBlock(id);
+
+        Memory = nullptr;
+    }
+
+    bool IsOpen() const {return Memory;}
+
+    //Forces the next sync to replay the whole table, e.g. after missing events that were meant to trigger syncs
+    void Invalidate() {bSynced = false;}
+
+    //One atomic load, true if the writer touched the region since the last sync
+    bool HasChanges() const {return !bSynced || GetRegion()->Sequence.load(std::memory_order_acquire) != LastSequence;}
+
+    /*Brings the caller's view up to date by replaying the changes since the last sync. If the caller fell further behind than the log
+    *  reaches, or never synced, OnReset is called and every record is replayed through OnUpsert instead. Returns true if it resynced*/
+    template<class ResetFunc, class UpsertFunc, class RemoveFunc>
+    bool Sync(ResetFunc OnReset, UpsertFunc OnUpsert, RemoveFunc OnRemove)
+    {
+        uint64_t Sequence;
+        uint64_t CurrentVersion;
+        bool bFullResync;
+
+        while (true)
+        {
+            const Region* Snapshot = GetRegion();
+            Sequence = Snapshot->Sequence.load(std::memory_order_acquire);
+            if (Sequence & 1)
+                continue;
+
+            //The writer grew the block, map the rest before reading records that may live there
+            const uint32_t MappedCapacity = Region::GetCapacity(Memory->Size);
+            if (Snapshot->Capacity > MappedCapacity && RefreshSharedMemoryBlock(id))
+                continue;
+
+            CurrentVersion = Snapshot->Version;
+            bFullResync = !bSynced || CurrentVersion < Version || CurrentVersion - Version > Region::LogCapacity;
+
+            if (bFullResync)
+            {
+                const uint32_t Count = std::min(Snapshot->Count, MappedCapacity);
+                RecordScratch.assign(Snapshot->Records, Snapshot->Records + Count);
+            }
+            else
+            {
+                DeltaScratch.clear();
+                for (uint64_t v = Version + 1; v <= CurrentVersion; ++v)
+                    DeltaScratch.push_back(Snapshot->Deltas[v & (Region::LogCapacity - 1)]);
+            }
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (Snapshot->Sequence.load(std::memory_order_relaxed) == Sequence)
+                break;
+        }
+
+        if (bFullResync)
+        {
+            OnReset();
+            for (const Record& Data : RecordScratch)
+                OnUpsert(Data);
+        }
+        else
+            for (const typename Region::Delta& Delta : DeltaScratch)
+                if (Delta.bRemoved)
+                    OnRemove(Delta.Data);
+                else
+                    OnUpsert(Delta.Data);
+
+        Version = CurrentVersion;
+        LastSequence = Sequence;
+        bSynced = true;
+        return bFullResync;
+    }
+
+private:
+
+    const Region* GetRegion() const {return (const Region*)Memory->Block;}
+
+    int id;
+    eipcSharedMemory* Memory;
+    uint64_t Version;
+    uint64_t LastSequence;
+    bool bSynced;
+
+    std::vector<Record> RecordScratch;
+    std::vector<typename Region::Delta> DeltaScratch;
+};
+}
@@ -26,6 +26,15 @@ euiEntity::euiEntity(float _x, float _y, float _Width, float _Height, euiAnchor
 	, Shader(nullptr)
 {}
 
+euiEntity::~euiEntity()
+{
+	delete VertexArray;
+	delete VertexBuffer;
+	delete Layout;
+	delete IndexBuffer;
+	delete Shader;
+}
+
 void euiEntity::Draw(euiRenderer& Renderer)
 {
 	Renderer.Draw(this);
@@ -374,6 +383,11 @@ euiImageEntity::euiImageEntity(float _x, float _y, float _Width, float _Height,
 	IndexBuffer->Unbind();
 }
 
+euiImageEntity::~euiImageEntity()
+{
+	delete Texture;
+}
+
 void euiImageEntity::Draw(class euiRenderer& Renderer)
 {
 	Renderer.Draw(this, Texture);
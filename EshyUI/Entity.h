@@ -29,6 +29,7 @@ class euiEntity
 public:
 
 	euiEntity(float x, float y, float Width, float Height, euiAnchor Anchor);
+	virtual ~euiEntity();
 
 	virtual void Draw(class euiRenderer& Renderer);
 
@@ -117,6 +118,7 @@ class euiImageEntity : public euiEntity
 public:
 
 	euiImageEntity(float x, float y, float Width, float Height, euiAnchor Anchor, euiRenderer* Renderer, const std::string& ImagePath);
+	virtual ~euiImageEntity() override;
 
 	virtual void Draw(class euiRenderer& Renderer) override;
 
@@ -1,16 +1,35 @@
-
 #pragma once
 
-#define ACTION_ADD_WINDOW           "ADD_WINDOW"
-#define ACTION_REMOVE_WINDOW        "REMOVE_WINDOW"
-#define ACTION_FOCUS_WINDOW         "FOCUS_WINDOW"
-#define ACTION_UNFOCUS_WINDOW       "UNFOCUS_WINDOW"
-#define ACTION_MINIMIZE_WINDOW      "MINIMIZE_WINDOW"
-#define ACTION_INIT_ESHYBAR         "INIT_ESHYBAR"
-#define ACTION_CONFIGURE_ESHYBAR    "CONFIGURE_ESHYBAR"
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "EshyIPC.h"
+
+#define ESHYWM_MESSAGE_APP_ID_LENGTH	64
+#define ESHYWM_MESSAGE_TITLE_LENGTH		256
 
-#define CLIENT_COMPOSITOR           "EshyWM"
-#define CLIENT_ESHYBAR              "Eshybar"
+//Room the window snapshot starts with, the compositor grows it when more windows are open
+#define ESHYWM_SNAPSHOT_INITIAL_WINDOWS	512
+#define ESHYWM_SNAPSHOT_LOG_CAPACITY	256
+
+enum EEshyWMAction : uint32_t
+{
+	ACTION_ADD_WINDOW,
+	ACTION_REMOVE_WINDOW,
+	ACTION_FOCUS_WINDOW,
+	ACTION_UNFOCUS_WINDOW,
+	ACTION_MINIMIZE_WINDOW,
+	ACTION_INIT_ESHYBAR,
+	ACTION_CONFIGURE_ESHYBAR,
+	ACTION_UPDATE_WINDOW
+};
+
+enum EEshyWMClient : uint32_t
+{
+	CLIENT_COMPOSITOR,
+	CLIENT_ESHYBAR
+};
 
 enum EEshyWMWindowState
 {
@@ -18,4 +37,51 @@ enum EEshyWMWindowState
 	ESHYWM_WINDOW_STATE_MINIMIZED,
 	ESHYWM_WINDOW_STATE_MAXIMIZED,
 	ESHYWM_WINDOW_STATE_FULLSCREEN
-};
\ No newline at end of file
+};
+
+//Fixed layout message exchanged between the compositor and its clients over EshyIPC::Channel
+struct EshyWMMessage
+{
+	EEshyWMAction Action;
+	EEshyWMClient SenderClient;
+	uint64_t WindowID;
+	int32_t Width;
+	int32_t Height;
+	char AppID[ESHYWM_MESSAGE_APP_ID_LENGTH];
+	char Title[ESHYWM_MESSAGE_TITLE_LENGTH];
+};
+
+static_assert(std::is_trivially_copyable_v<EshyWMMessage>, "EshyWMMessage is sent as raw bytes");
+
+//One window as published in the window snapshot
+struct EshyWMWindowRecord
+{
+	uint64_t ID;
+	char AppID[ESHYWM_MESSAGE_APP_ID_LENGTH];
+	char Title[ESHYWM_MESSAGE_TITLE_LENGTH];
+	EEshyWMWindowState State;
+	uint32_t bFocused;
+	//Index into the compositor's output list, -1 if the window is not on any output
+	int32_t Output;
+};
+
+static_assert(std::is_trivially_copyable_v<EshyWMWindowRecord>, "EshyWMWindowRecord is copied as raw bytes");
+
+typedef eipcSnapshotRegion<EshyWMWindowRecord, ESHYWM_SNAPSHOT_INITIAL_WINDOWS, ESHYWM_SNAPSHOT_LOG_CAPACITY> EshyWMWindowSnapshot;
+
+//Copies Source into a fixed size field, truncating if needed. The result is always null terminated
+template<size_t Size>
+static inline void CopyBoundedString(char (&Destination)[Size], const char* Source)
+{
+	strncpy(Destination, Source ? Source : "", Size - 1);
+	Destination[Size - 1] = '\0';
+}
+
+static inline EshyWMMessage MakeMessage(EEshyWMAction Action, EEshyWMClient SenderClient, uint64_t WindowID = 0)
+{
+	EshyWMMessage Message = {};
+	Message.Action = Action;
+	Message.SenderClient = SenderClient;
+	Message.WindowID = WindowID;
+	return Message;
+}
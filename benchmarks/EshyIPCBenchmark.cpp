@@ -0,0 +1,544 @@
+
+#include "EshyIPC.h"
+#include "Shared.h"
+
+#include <nlohmann/json.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <cstring>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*Producer and consumer processes exchanging window messages over each EshyIPC path. Prints one JSON object per backend:
+*  throughput, end to end latency percentiles and CPU time per sent and per delivered message across both processes.*/
+
+#define LEGACY_BLOCK_SIZE   4096
+#define BENCHMARK_TIMEOUT_NS (30ull * 1000000000ull)
+
+//EshyWMMessage plus what the consumer needs to measure it
+struct BenchmarkMessage
+{
+    uint64_t Sequence;
+    uint64_t SendTime;
+    EshyWMMessage Message;
+};
+
+//One window in the snapshot benchmark, stamped like BenchmarkMessage
+struct BenchmarkRecord
+{
+    uint64_t ID;
+    uint64_t Sequence;
+    uint64_t SendTime;
+    EshyWMWindowRecord Window;
+};
+
+typedef eipcSnapshotRegion<BenchmarkRecord, ESHYWM_SNAPSHOT_INITIAL_WINDOWS, ESHYWM_SNAPSHOT_LOG_CAPACITY> BenchmarkSnapshot;
+
+struct BenchmarkOptions
+{
+    uint64_t Messages = 100000;
+    uint64_t Rate = 0;
+    //Distinct windows the snapshot benchmark cycles through, past ESHYWM_SNAPSHOT_INITIAL_WINDOWS the table has to grow
+    uint64_t Windows = 2048;
+    std::string Backend = "all";
+};
+
+struct BenchmarkResult
+{
+    uint64_t Received = 0;
+    //Messages that arrived damaged, torn or unparseable. Messages a reader was lapped on are only lost and count as overruns
+    uint64_t Corrupt = 0;
+    uint64_t Overruns = 0;
+    uint64_t ElapsedNs = 0;
+    uint64_t ConsumerCpuNs = 0;
+    uint64_t ProducerCpuNs = 0;
+    std::vector<uint64_t> Latencies;
+};
+
+//There is nothing to measure without the block
+static char* AttachBlock(int id)
+{
+    char* Block = EshyIPC::AttachSharedMemoryBlock(id).Block;
+    if (!Block)
+    {
+        fprintf(stderr, "Failed to map shared memory block %d\n", id);
+        exit(1);
+    }
+
+    return Block;
+}
+
+static uint64_t Now()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec * 1000000000ull + Time.tv_nsec;
+}
+
+static uint64_t CpuTime()
+{
+    struct rusage Usage;
+    getrusage(RUSAGE_SELF, &Usage);
+    return (Usage.ru_utime.tv_sec + Usage.ru_stime.tv_sec) * 1000000000ull + (Usage.ru_utime.tv_usec + Usage.ru_stime.tv_usec) * 1000ull;
+}
+
+static EshyWMMessage MakeWindowMessage(uint64_t Sequence)
+{
+    EshyWMMessage Message = MakeMessage(ACTION_ADD_WINDOW, CLIENT_COMPOSITOR, 0x7f0000000000ull + Sequence * 64);
+    CopyBoundedString(Message.AppID, "org.gnome.Terminal");
+    CopyBoundedString(Message.Title, "eshy@eshywm: ~/eshywm/build");
+    return Message;
+}
+
+//Spins until the next message is due when a rate is set
+static void Pace(const BenchmarkOptions& Options, uint64_t Start, uint64_t Sequence)
+{
+    if (Options.Rate == 0)
+        return;
+
+    const uint64_t Due = Start + Sequence * 1000000000ull / Options.Rate;
+    while (Now() < Due)
+        sched_yield();
+}
+
+/*Runs Producer in a child process and Consumer in this one. The producer's CPU time comes back over a pipe*/
+template<class ProducerFunc, class ConsumerFunc>
+static BenchmarkResult RunProcesses(ProducerFunc Producer, ConsumerFunc Consumer)
+{
+    int Pipe[2];
+    if (pipe(Pipe) < 0)
+        return BenchmarkResult();
+
+    BenchmarkResult Result;
+    Result.Latencies.reserve(1 << 20);
+
+    const uint64_t Start = Now();
+    const uint64_t StartCpu = CpuTime();
+
+    const pid_t Child = fork();
+    if (Child == 0)
+    {
+        close(Pipe[0]);
+        const uint64_t ChildStartCpu = CpuTime();
+        Producer();
+        const uint64_t ProducerCpuNs = CpuTime() - ChildStartCpu;
+        write(Pipe[1], &ProducerCpuNs, sizeof(ProducerCpuNs));
+        _exit(0);
+    }
+
+    close(Pipe[1]);
+    const uint64_t End = Consumer(Result, Start);
+    Result.ElapsedNs = End - Start;
+    Result.ConsumerCpuNs = CpuTime() - StartCpu;
+
+    read(Pipe[0], &Result.ProducerCpuNs, sizeof(Result.ProducerCpuNs));
+    close(Pipe[0]);
+    waitpid(Child, NULL, 0);
+    return Result;
+}
+
+/*The original path, a JSON string copied over a single SysV block that the reader polls for changes. Anything overwritten before the
+*  reader looked at it is lost and a read racing a write can see a torn string*/
+static BenchmarkResult RunLegacy(const BenchmarkOptions& Options)
+{
+    const int id = EshyIPC::MakeSharedMemoryBlock("eshyipcbenchshm", LEGACY_BLOCK_SIZE);
+    char* Block = AttachBlock(id);
+    Block[0] = '\0';
+
+    BenchmarkResult Result = RunProcesses(
+        [&]()
+        {
+            const uint64_t Start = Now();
+            for (uint64_t i = 0; i < Options.Messages; ++i)
+            {
+                Pace(Options, Start, i);
+
+                const EshyWMMessage Message = MakeWindowMessage(i);
+                nlohmann::json Data;
+                Data["action"] = Message.Action;
+                Data["sender_client"] = Message.SenderClient;
+                Data["window_id"] = Message.WindowID;
+                Data["app_id"] = Message.AppID;
+                Data["title"] = Message.Title;
+                Data["sequence"] = i;
+                Data["send_time"] = Now();
+                strncpy(Block, Data.dump().c_str(), LEGACY_BLOCK_SIZE);
+            }
+        },
+        [&](BenchmarkResult& Result, uint64_t Start)
+        {
+            std::string CurrentShm;
+            while (Now() - Start < BENCHMARK_TIMEOUT_NS)
+            {
+                //Yield while idle so the spinning side cannot starve the other on a single core
+                if (CurrentShm == Block)
+                {
+                    sched_yield();
+                    continue;
+                }
+
+                CurrentShm = Block;
+                const uint64_t ReceiveTime = Now();
+
+                nlohmann::json Data = nlohmann::json::parse(CurrentShm, nullptr, false);
+                if (Data.is_discarded() || !Data.contains("sequence") || !Data.contains("send_time"))
+                {
+                    Result.Corrupt++;
+                    continue;
+                }
+
+                Result.Received++;
+                Result.Latencies.push_back(ReceiveTime - (uint64_t)Data["send_time"]);
+
+                if ((uint64_t)Data["sequence"] == Options.Messages - 1)
+                    return ReceiveTime;
+            }
+
+            return Now();
+        });
+
+    EshyIPC::DetachSharedMemoryBlock(id);
+    EshyIPC::DestroySharedMemoryBlock(id);
+    remove("eshyipcbenchshm");
+    return Result;
+}
+
+/*Typed channel over a memfd segment. With bWait the consumer sleeps on the eventfd notifier like Eshybar does, otherwise it spins on
+*  the generation counter*/
+static BenchmarkResult RunChannel(const BenchmarkOptions& Options, bool bWait)
+{
+    const int id = EshyIPC::MakeSharedMemoryFd("eshyipcbench", sizeof(eipcSharedSegment));
+    AttachBlock(id);
+    EshyIPC::InitializeSegment(id);
+    EshyIPC::SetNotifier(id, EIPC_TO_CLIENT, EshyIPC::MakeNotifier());
+
+    BenchmarkResult Result = RunProcesses(
+        [&]()
+        {
+            EshyIPC::Channel<BenchmarkMessage> SendChannel;
+            SendChannel.Open(id, EIPC_TO_CLIENT);
+
+            const uint64_t Start = Now();
+            for (uint64_t i = 0; i < Options.Messages; ++i)
+            {
+                Pace(Options, Start, i);
+
+                BenchmarkMessage Message;
+                Message.Sequence = i;
+                Message.Message = MakeWindowMessage(i);
+                Message.SendTime = Now();
+                SendChannel.Send(Message);
+            }
+
+            //Whatever is still backlogged goes out as the consumer frees slots
+            while (Now() - Start < BENCHMARK_TIMEOUT_NS)
+            {
+                SendChannel.Flush();
+                if (!EshyIPC::HasPendingMessages(id, EIPC_TO_CLIENT))
+                    break;
+
+                sched_yield();
+            }
+        },
+        [&](BenchmarkResult& Result, uint64_t Start)
+        {
+            EshyIPC::Channel<BenchmarkMessage> ReceiveChannel;
+            ReceiveChannel.Open(id, EIPC_TO_CLIENT);
+
+            const int Notifier = EshyIPC::GetNotifier(id, EIPC_TO_CLIENT);
+            BenchmarkMessage Message;
+            while (Result.Received < Options.Messages && Now() - Start < BENCHMARK_TIMEOUT_NS)
+            {
+                if (bWait)
+                    EshyIPC::WaitForNotifier(Notifier, 100);
+
+                if (!ReceiveChannel.HasNewMessages() && !bWait)
+                {
+                    sched_yield();
+                    continue;
+                }
+
+                while (ReceiveChannel.Receive(Message))
+                {
+                    Result.Received++;
+                    Result.Latencies.push_back(Now() - Message.SendTime);
+                }
+            }
+
+            return Now();
+        });
+
+    close(EshyIPC::GetNotifier(id, EIPC_TO_CLIENT));
+    EshyIPC::DetachSharedMemoryBlock(id);
+    EshyIPC::DestroySharedMemoryBlock(id);
+    return Result;
+}
+
+/*Broadcast ring over a memfd segment with the consumer sleeping on its futex. The producer never waits, so a consumer that falls behind
+*  loses messages, they show up as lost and each time it was lapped as an overrun*/
+static BenchmarkResult RunBroadcast(const BenchmarkOptions& Options)
+{
+    const int id = EshyIPC::MakeSharedMemoryFd("eshyipcbench", sizeof(eipcBroadcastRing));
+    AttachBlock(id);
+    EshyIPC::InitializeBroadcast(id);
+
+    BenchmarkResult Result = RunProcesses(
+        [&]()
+        {
+            EshyIPC::BroadcastChannel<BenchmarkMessage> SendChannel;
+            SendChannel.Open(id);
+
+            const uint64_t Start = Now();
+            for (uint64_t i = 0; i < Options.Messages; ++i)
+            {
+                Pace(Options, Start, i);
+
+                BenchmarkMessage Message;
+                Message.Sequence = i;
+                Message.Message = MakeWindowMessage(i);
+                Message.SendTime = Now();
+                SendChannel.Send(Message);
+            }
+        },
+        [&](BenchmarkResult& Result, uint64_t Start)
+        {
+            //Opened before the producer can publish anything, the cursor starts at the first message
+            EshyIPC::BroadcastChannel<BenchmarkMessage> ReceiveChannel;
+            ReceiveChannel.Open(id);
+
+            BenchmarkMessage Message;
+            while (Now() - Start < BENCHMARK_TIMEOUT_NS)
+            {
+                //An overrun skips to the newest message, so the last one can be lost too and going idle is the only end
+                const uint64_t IdleStart = Now();
+                if (!ReceiveChannel.Wait(100) && Result.Received + Result.Overruns > 0)
+                    return IdleStart;
+
+                eipcReceiveResult ReceiveResult;
+                while ((ReceiveResult = ReceiveChannel.Receive(Message)) != EIPC_RECEIVE_EMPTY)
+                {
+                    if (ReceiveResult == EIPC_RECEIVE_OVERRUN)
+                    {
+                        Result.Overruns++;
+                        continue;
+                    }
+
+                    Result.Received++;
+                    Result.Latencies.push_back(Now() - Message.SendTime);
+
+                    if (Message.Sequence == Options.Messages - 1)
+                        return Now();
+                }
+            }
+
+            return Now();
+        });
+
+    EshyIPC::DetachSharedMemoryBlock(id);
+    EshyIPC::DestroySharedMemoryBlock(id);
+    return Result;
+}
+
+/*Window snapshot over a memfd segment. The producer upserts Windows different windows over and over, growing the table while the
+*  consumer syncs and remaps. Updates to a window the consumer has not synced yet replace each other, so lost counts updates it never
+*  had to see. The consumer's view is checked against what was written, a mismatch counts as corrupt*/
+static BenchmarkResult RunSnapshot(const BenchmarkOptions& Options)
+{
+    const int id = EshyIPC::MakeSharedMemoryFd("eshyipcbench", sizeof(BenchmarkSnapshot));
+    if (id < 0)
+    {
+        fprintf(stderr, "Failed to create the snapshot block\n");
+        exit(1);
+    }
+
+    //Created before the fork so the consumer can sync straight away
+    EshyIPC::SnapshotWriter<BenchmarkSnapshot> Writer;
+    if (!Writer.Open(id))
+    {
+        fprintf(stderr, "Failed to map shared memory block %d\n", id);
+        exit(1);
+    }
+
+    BenchmarkResult Result = RunProcesses(
+        [&]()
+        {
+            const uint64_t Start = Now();
+            for (uint64_t i = 0; i < Options.Messages; ++i)
+            {
+                Pace(Options, Start, i);
+
+                BenchmarkRecord Record;
+                Record.ID = i % Options.Windows + 1;
+                Record.Sequence = i;
+                Record.Window = {};
+                Record.Window.ID = Record.ID;
+                Record.Window.Output = (int32_t)Record.ID;
+                Record.SendTime = Now();
+                if (!Writer.Upsert(Record))
+                {
+                    fprintf(stderr, "Snapshot could not grow past %u windows\n", Writer.GetCapacity());
+                    return;
+                }
+            }
+        },
+        [&](BenchmarkResult& Result, uint64_t Start)
+        {
+            EshyIPC::SnapshotReader<BenchmarkSnapshot> Reader;
+            if (!Reader.Open(id))
+                return Now();
+
+            std::vector<bool> Seen(Options.Windows + 1, false);
+            uint64_t SeenCount = 0;
+            bool bDone = false;
+            const auto OnUpsert = [&](const BenchmarkRecord& Record)
+            {
+                if (Record.ID == 0 || Record.ID > Options.Windows || Record.Window.ID != Record.ID || Record.Window.Output != (int32_t)Record.ID)
+                {
+                    Result.Corrupt++;
+                    return;
+                }
+
+                if (!Seen[Record.ID])
+                {
+                    Seen[Record.ID] = true;
+                    SeenCount++;
+                }
+
+                Result.Received++;
+                Result.Latencies.push_back(Now() - Record.SendTime);
+                bDone |= Record.Sequence == Options.Messages - 1;
+            };
+
+            while (!bDone && Now() - Start < BENCHMARK_TIMEOUT_NS)
+            {
+                if (!Reader.HasChanges())
+                {
+                    sched_yield();
+                    continue;
+                }
+
+                //A resync replays the whole table, only what is live is expected afterwards
+                Reader.Sync([&]() {std::fill(Seen.begin(), Seen.end(), false); SeenCount = 0;}, OnUpsert, [&](const BenchmarkRecord&) {Result.Corrupt++;});
+            }
+
+            const uint64_t End = Now();
+            if (bDone && SeenCount != std::min(Options.Messages, Options.Windows))
+                Result.Corrupt++;
+
+            Reader.Close();
+            return End;
+        });
+
+    Writer.Close();
+    EshyIPC::DestroySharedMemoryBlock(id);
+    return Result;
+}
+
+static uint64_t Percentile(const std::vector<uint64_t>& Sorted, double Fraction)
+{
+    if (Sorted.empty())
+        return 0;
+
+    return Sorted[std::min(Sorted.size() - 1, (size_t)(Fraction * Sorted.size()))];
+}
+
+static void PrintResult(const std::string& Backend, const BenchmarkOptions& Options, BenchmarkResult& Result)
+{
+    std::sort(Result.Latencies.begin(), Result.Latencies.end());
+
+    nlohmann::json Report;
+    Report["backend"] = Backend;
+    Report["messages_sent"] = Options.Messages;
+    Report["messages_received"] = Result.Received;
+    Report["messages_lost"] = Options.Messages - std::min(Options.Messages, Result.Received);
+    Report["messages_corrupt"] = Result.Corrupt;
+    Report["overruns"] = Result.Overruns;
+    Report["rate"] = Options.Rate;
+    Report["elapsed_ns"] = Result.ElapsedNs;
+    Report["msgs_per_sec"] = Result.ElapsedNs ? Result.Received * 1e9 / Result.ElapsedNs : 0.0;
+    Report["latency_ns"]["p50"] = Percentile(Result.Latencies, 0.5);
+    Report["latency_ns"]["p99"] = Percentile(Result.Latencies, 0.99);
+    Report["latency_ns"]["p999"] = Percentile(Result.Latencies, 0.999);
+    Report["latency_ns"]["max"] = Result.Latencies.empty() ? 0 : Result.Latencies.back();
+    //Per message sent so lossy paths do not look cheaper for dropping work, per delivered message for what each arrival cost
+    Report["cpu_ns_per_msg"]["producer"] = (double)Result.ProducerCpuNs / Options.Messages;
+    Report["cpu_ns_per_msg"]["consumer"] = (double)Result.ConsumerCpuNs / Options.Messages;
+    Report["cpu_ns_per_msg"]["total"] = (double)(Result.ProducerCpuNs + Result.ConsumerCpuNs) / Options.Messages;
+    Report["cpu_ns_per_received_msg"]["total"] = Result.Received ? (double)(Result.ProducerCpuNs + Result.ConsumerCpuNs) / Result.Received : 0.0;
+
+    printf("%s\n", Report.dump().c_str());
+    fflush(stdout);
+}
+
+static void PrintUsage(const char* Name)
+{
+    fprintf(stderr, "Usage: %s [--messages N] [--rate MSGS_PER_SEC] [--windows N] [--backend all|legacy|channel|channel-wait|broadcast|snapshot]\n", Name);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions Options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string Argument = argv[i];
+        if (i + 1 >= argc)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (Argument == "--messages")
+            Options.Messages = std::max(1ull, strtoull(argv[++i], NULL, 10));
+        else if (Argument == "--rate")
+            Options.Rate = strtoull(argv[++i], NULL, 10);
+        else if (Argument == "--windows")
+            Options.Windows = std::max(1ull, strtoull(argv[++i], NULL, 10));
+        else if (Argument == "--backend")
+            Options.Backend = argv[++i];
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (Options.Backend == "all" || Options.Backend == "legacy")
+    {
+        BenchmarkResult Result = RunLegacy(Options);
+        PrintResult("legacy-json-sysv", Options, Result);
+    }
+
+    if (Options.Backend == "all" || Options.Backend == "channel")
+    {
+        BenchmarkResult Result = RunChannel(Options, false);
+        PrintResult("channel-memfd-spin", Options, Result);
+    }
+
+    if (Options.Backend == "all" || Options.Backend == "channel-wait")
+    {
+        BenchmarkResult Result = RunChannel(Options, true);
+        PrintResult("channel-memfd-eventfd", Options, Result);
+    }
+
+    if (Options.Backend == "all" || Options.Backend == "broadcast")
+    {
+        BenchmarkResult Result = RunBroadcast(Options);
+        PrintResult("broadcast-memfd-futex", Options, Result);
+    }
+
+    if (Options.Backend == "all" || Options.Backend == "snapshot")
+    {
+        BenchmarkResult Result = RunSnapshot(Options);
+        PrintResult("snapshot-memfd-grow", Options, Result);
+    }
+
+    return 0;
+}
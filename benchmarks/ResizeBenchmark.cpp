@@ -0,0 +1,179 @@
+
+#include "ResizeThrottle.h"
+
+#include <nlohmann/json.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <deque>
+#include <algorithm>
+
+/*Scripted interactive resize against a simulated client, with and without the configure throttle. The pointer drags the right edge one
+*  pixel per motion event at a fixed rate, the client needs a fixed time to draw each configure it handles and handles them in order.
+*  Runs in virtual time so results do not depend on the machine. Prints one JSON object per mode.*/
+
+struct BenchmarkOptions
+{
+    double Rate = 1000.0;
+    double DurationMs = 2000.0;
+    double ClientMs = 25.0;
+    std::string Mode = "all";
+};
+
+struct BenchmarkResult
+{
+    uint64_t MotionEvents = 0;
+    uint64_t ConfiguresSent = 0;
+    uint64_t ConfiguresCommitted = 0;
+    uint64_t MaxClientBacklog = 0;
+    int FinalWidth = 0;
+    double ReleaseMs = 0.0;
+    double FinalCommitMs = 0.0;
+};
+
+struct Configure
+{
+    uint32_t Serial;
+    int Width;
+    double ReceivedMs;
+};
+
+//Draws configures one at a time in the order they arrived
+class SimulatedClient
+{
+public:
+
+    void Receive(const Configure& Configure, BenchmarkResult& Result)
+    {
+        Queue.push_back(Configure);
+        Result.MaxClientBacklog = std::max<uint64_t>(Result.MaxClientBacklog, Queue.size());
+    }
+
+    //Commits everything finished by Time, oldest first
+    template<typename OnCommit>
+    void Advance(double Time, double ClientMs, OnCommit Commit)
+    {
+        while (!Queue.empty())
+        {
+            const double Done = std::max(Queue.front().ReceivedMs, LastDoneMs) + ClientMs;
+            if (Done > Time)
+                return;
+
+            const Configure Drawn = Queue.front();
+            Queue.pop_front();
+            LastDoneMs = Done;
+            Commit(Drawn, Done);
+        }
+    }
+
+private:
+
+    std::deque<Configure> Queue;
+    double LastDoneMs = 0.0;
+};
+
+static BenchmarkResult Run(const BenchmarkOptions& Options, bool bThrottled)
+{
+    BenchmarkResult Result;
+    SimulatedClient Client;
+    EshyWMResizeThrottle Throttle;
+    uint32_t NextSerial = 1;
+
+    const auto Send = [&](int Width, double Time)
+    {
+        const uint32_t Serial = NextSerial++;
+        Client.Receive({Serial, Width, Time}, Result);
+        Result.ConfiguresSent++;
+        return Serial;
+    };
+
+    const auto Commit = [&](const Configure& Drawn, double Time)
+    {
+        Result.ConfiguresCommitted++;
+        Result.FinalWidth = Drawn.Width;
+        Result.FinalCommitMs = Time;
+
+        if (bThrottled && Throttle.Committed(Drawn.Serial) && Throttle.HasPending())
+            Throttle.Sent(Send(Throttle.TakePending().Width, Time));
+    };
+
+    const uint64_t Events = (uint64_t)(Options.DurationMs * Options.Rate / 1000.0);
+    for (uint64_t i = 0; i < Events; ++i)
+    {
+        const double Time = i * 1000.0 / Options.Rate;
+        Client.Advance(Time, Options.ClientMs, Commit);
+
+        const int Width = 400 + (int)i;
+        Result.MotionEvents++;
+        Result.ReleaseMs = Time;
+
+        if (!bThrottled)
+            Send(Width, Time);
+        else if (Throttle.Queue({0, 0, Width, 300, 0}))
+            Throttle.Sent(Send(Throttle.TakePending().Width, Time));
+    }
+
+    //Button released, let the client catch up
+    Client.Advance(1e300, Options.ClientMs, Commit);
+    return Result;
+}
+
+static void PrintResult(const std::string& Mode, const BenchmarkOptions& Options, const BenchmarkResult& Result)
+{
+    nlohmann::json Report;
+    Report["mode"] = Mode;
+    Report["motion_rate"] = Options.Rate;
+    Report["client_ms_per_frame"] = Options.ClientMs;
+    Report["motion_events"] = Result.MotionEvents;
+    Report["configures_sent"] = Result.ConfiguresSent;
+    Report["configures_committed"] = Result.ConfiguresCommitted;
+    Report["max_client_backlog"] = Result.MaxClientBacklog;
+    Report["final_width"] = Result.FinalWidth;
+    Report["settle_ms_after_release"] = Result.FinalCommitMs - Result.ReleaseMs;
+
+    printf("%s\n", Report.dump().c_str());
+    fflush(stdout);
+}
+
+static void PrintUsage(const char* Name)
+{
+    fprintf(stderr, "Usage: %s [--rate MOTION_EVENTS_PER_SEC] [--duration-ms MS] [--client-ms MS_PER_FRAME] [--mode all|throttled|unthrottled]\n", Name);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions Options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string Argument = argv[i];
+        if (i + 1 >= argc)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (Argument == "--rate")
+            Options.Rate = std::max(1.0, strtod(argv[++i], NULL));
+        else if (Argument == "--duration-ms")
+            Options.DurationMs = strtod(argv[++i], NULL);
+        else if (Argument == "--client-ms")
+            Options.ClientMs = strtod(argv[++i], NULL);
+        else if (Argument == "--mode")
+            Options.Mode = argv[++i];
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (Options.Mode == "all" || Options.Mode == "unthrottled")
+        PrintResult("unthrottled", Options, Run(Options, false));
+
+    if (Options.Mode == "all" || Options.Mode == "throttled")
+        PrintResult("throttled", Options, Run(Options, true));
+
+    return 0;
+}
@@ -0,0 +1,159 @@
+
+#include "TileLayout.h"
+
+#include <nlohmann/json.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+/*Relayout cost of EshyWMTileLayout with a tree of a given number of leaves, split at random places. Times inserting next to a random
+*  leaf, removing one, dragging a divider and, for comparison, laying out the whole tree after an area change. Prints one JSON object per
+*  operation with the time, tree nodes visited and clients placed per operation.*/
+
+struct BenchmarkOptions
+{
+    uint64_t Leaves = 1000;
+    uint64_t Iterations = 10000;
+};
+
+static uint64_t Placements = 0;
+
+static void CountPlacement(void*, const EshyWMTileRect&)
+{
+    Placements++;
+}
+
+static uint64_t Now()
+{
+    struct timespec Time;
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec * 1000000000ull + Time.tv_nsec;
+}
+
+//Deterministic so runs are comparable
+static uint64_t NextRandom(uint64_t& State)
+{
+    State = State * 6364136223846793005ull + 1442695040888963407ull;
+    return State >> 33;
+}
+
+static void PrintResult(const std::string& Operation, const BenchmarkOptions& Options, uint64_t Operations, uint64_t ElapsedNs, uint64_t Nodes, uint64_t Placed)
+{
+    nlohmann::json Report;
+    Report["operation"] = Operation;
+    Report["leaves"] = Options.Leaves;
+    Report["operations"] = Operations;
+    Report["ns_per_op"] = (double)ElapsedNs / Operations;
+    Report["nodes_per_op"] = (double)Nodes / Operations;
+    Report["placements_per_op"] = (double)Placed / Operations;
+
+    printf("%s\n", Report.dump().c_str());
+    fflush(stdout);
+}
+
+static void PrintUsage(const char* Name)
+{
+    fprintf(stderr, "Usage: %s [--leaves N] [--iterations N]\n", Name);
+}
+
+int main(int argc, char* argv[])
+{
+    BenchmarkOptions Options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        const std::string Argument = argv[i];
+        if (i + 1 >= argc)
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        if (Argument == "--leaves")
+            Options.Leaves = std::max(2ull, strtoull(argv[++i], NULL, 10));
+        else if (Argument == "--iterations")
+            Options.Iterations = std::max(1ull, strtoull(argv[++i], NULL, 10));
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    EshyWMTileLayout Layout(CountPlacement);
+    Layout.SetArea({0, 0, 7680, 4320});
+
+    uint64_t Random = 1;
+    std::vector<EshyWMTileNode*> Leaves;
+    for (uint64_t i = 0; i < Options.Leaves; ++i)
+        Leaves.push_back(Layout.Insert(nullptr, Leaves.empty() ? nullptr : Leaves[NextRandom(Random) % Leaves.size()]));
+
+    //Remove a random leaf and put a new one next to another, the tree stays at the requested size
+    {
+        uint64_t RemoveNs = 0;
+        uint64_t InsertNs = 0;
+        uint64_t RemoveNodes = 0;
+        uint64_t InsertNodes = 0;
+        uint64_t RemovePlacements = 0;
+        uint64_t InsertPlacements = 0;
+
+        for (uint64_t i = 0; i < Options.Iterations; ++i)
+        {
+            const size_t Removed = NextRandom(Random) % Leaves.size();
+            uint64_t Nodes = Layout.GetNodesLaidOut();
+            uint64_t Placed = Placements;
+            uint64_t Start = Now();
+            Layout.Remove(Leaves[Removed]);
+            RemoveNs += Now() - Start;
+            RemoveNodes += Layout.GetNodesLaidOut() - Nodes;
+            RemovePlacements += Placements - Placed;
+
+            Leaves[Removed] = Leaves.back();
+            Leaves.pop_back();
+
+            EshyWMTileNode* Target = Leaves[NextRandom(Random) % Leaves.size()];
+            Nodes = Layout.GetNodesLaidOut();
+            Placed = Placements;
+            Start = Now();
+            Leaves.push_back(Layout.Insert(nullptr, Target));
+            InsertNs += Now() - Start;
+            InsertNodes += Layout.GetNodesLaidOut() - Nodes;
+            InsertPlacements += Placements - Placed;
+        }
+
+        PrintResult("insert", Options, Options.Iterations, InsertNs, InsertNodes, InsertPlacements);
+        PrintResult("remove", Options, Options.Iterations, RemoveNs, RemoveNodes, RemovePlacements);
+    }
+
+    //Drag the divider next to a random leaf back and forth
+    {
+        const uint64_t Nodes = Layout.GetNodesLaidOut();
+        const uint64_t Placed = Placements;
+        const uint64_t Start = Now();
+        for (uint64_t i = 0; i < Options.Iterations; ++i)
+        {
+            EshyWMTileNode* Leaf = Leaves[NextRandom(Random) % Leaves.size()];
+            const EshyWMTileRect& Rect = Leaf->Parent->Rect;
+            Layout.MoveDivider(Leaf, Rect.X + (int)(NextRandom(Random) % std::max(1, Rect.Width)), Rect.Y + (int)(NextRandom(Random) % std::max(1, Rect.Height)));
+        }
+
+        PrintResult("move_divider", Options, Options.Iterations, Now() - Start, Layout.GetNodesLaidOut() - Nodes, Placements - Placed);
+    }
+
+    //What every change would cost if the whole tree were laid out each time, shifting the origin moves every tile
+    {
+        const uint64_t Nodes = Layout.GetNodesLaidOut();
+        const uint64_t Placed = Placements;
+        const uint64_t Start = Now();
+        for (uint64_t i = 0; i < Options.Iterations; ++i)
+            Layout.SetArea({(int)(~i & 1), 0, 7680, 4320});
+
+        PrintResult("full_relayout", Options, Options.Iterations, Now() - Start, Layout.GetNodesLaidOut() - Nodes, Placements - Placed);
+    }
+
+    return 0;
+}
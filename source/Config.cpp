@@ -4,6 +4,7 @@
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 #include <xkbcommon/xkbcommon.h>
 
@@ -94,6 +95,8 @@ enum EshyWMConfigSections
 enum VarType
 {
     VT_INT,
+    VT_FLOAT,
+    VT_BOOL,
     VT_UINT,
     VT_UINT_HEX,
     VT_ULONG,
@@ -128,6 +131,12 @@ static bool parse_config_option(std::string line, VarType type, void* config_var
         case VarType::VT_INT:
             *((int*)config_var) = std::stoi(kvp.value);
             break;
+        case VarType::VT_FLOAT:
+            *((float*)config_var) = std::stof(kvp.value);
+            break;
+        case VarType::VT_BOOL:
+            *((bool*)config_var) = kvp.value == "true" || kvp.value == "1";
+            break;
         case VarType::VT_UINT:
             *((uint*)config_var) = std::stoi(kvp.value);
             break;
@@ -192,6 +201,12 @@ float ESHYWM_COLOR_BORDER_FOCUSED[4] = {0.0f, 0.5f, 0.5f, 1.0f};
 
 int ESHYWM_BORDER_WIDTH = 1;
 
+int ESHYWM_METADATA_UPDATE_INTERVAL = 0;
+
+bool ESHYWM_COALESCE_GRAB_MOTION = true;
+
+bool ESHYWM_TILING = false;
+
 void InitializeKeys()
 {
     KeyMap.emplace(ESHYWM_KEY_1, XKB_KEY_1);
@@ -269,7 +284,7 @@ void ReadConfigFromFile(const std::string& ConfigFilePath)
     std::string Line;
 
     EshyWMConfigSections CurrentConfigSection = CONFIG_NONE;
-    EshyWMMonitorInfo MonitorInfo = {"", 0, 0, 0, 0, 0, 0};
+    EshyWMMonitorInfo MonitorInfo = {"", 0, 0, 0, 0, 0, 0, false, 0};
 
     while (std::getline(ConfigFile, Line))
     {   
@@ -279,7 +294,7 @@ void ReadConfigFromFile(const std::string& ConfigFilePath)
             if(MonitorInfo.Name != "")
             {
                 MonitorInfoList.push_back(MonitorInfo);
-                MonitorInfo = {"", 0, 0, 0, 0, 0, 0};
+                MonitorInfo = {"", 0, 0, 0, 0, 0, 0, false, 0};
             }
 
             CurrentConfigSection = CONFIG_NONE;
@@ -302,7 +317,13 @@ void ReadConfigFromFile(const std::string& ConfigFilePath)
             parse_config_option(Line, VT_INT, &MonitorInfo.Refresh, "refresh");
             parse_config_option(Line, VT_INT, &MonitorInfo.OffsetX, "offsetx");
             parse_config_option(Line, VT_INT, &MonitorInfo.OffsetY, "offsety");
-            parse_config_option(Line, VT_INT, &MonitorInfo.Scale, "scaling");
+            parse_config_option(Line, VT_FLOAT, &MonitorInfo.Scale, "scaling");
+            parse_config_option(Line, VT_FLOAT, &MonitorInfo.Scale, "scale=");
+            parse_config_option(Line, VT_BOOL, &MonitorInfo.bAdaptiveSync, "adaptive_sync");
+
+            std::string MaxRenderTime;
+            if(parse_config_option(Line, VT_STRING, &MaxRenderTime, "max_render_time"))
+                MonitorInfo.MaxRenderTime = MaxRenderTime == "auto" ? ESHYWM_MAX_RENDER_TIME_AUTO : MaxRenderTime == "off" ? 0 : std::max(0, std::stoi(MaxRenderTime));
             break;
         }
         case CONFIG_NONE:
@@ -316,6 +337,10 @@ void ReadConfigFromFile(const std::string& ConfigFilePath)
             parse_config_option(Line, VT_INT, &ESHYWM_BORDER_WIDTH, "border_width");
             parse_config_option(Line, VT_COLOR, &ESHYWM_COLOR_BORDER_NORMAL, "border_color_normal");
             parse_config_option(Line, VT_COLOR, &ESHYWM_COLOR_BORDER_FOCUSED, "border_color_focused");
+
+            parse_config_option(Line, VT_INT, &ESHYWM_METADATA_UPDATE_INTERVAL, "metadata_update_interval");
+            parse_config_option(Line, VT_BOOL, &ESHYWM_COALESCE_GRAB_MOTION, "coalesce_grab_motion");
+            parse_config_option(Line, VT_BOOL, &ESHYWM_TILING, "tiling");
             break;
         }
         default:
@@ -0,0 +1,154 @@
+#include "Decoration.h"
+#include "Config.h"
+
+#define static
+
+extern "C"
+{
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
+#include <drm_fourcc.h>
+}
+
+#undef static
+
+#include <cmath>
+
+//A 1x1 buffer of one color, read straight from memory by the renderer
+struct EshyWMSolidBuffer
+{
+	struct wlr_buffer Base;
+	uint32_t Pixel;
+	uint32_t Format;
+};
+
+static void SolidBufferDestroy(struct wlr_buffer* Buffer)
+{
+	EshyWMSolidBuffer* Solid = wl_container_of(Buffer, Solid, Base);
+	delete Solid;
+}
+
+static bool SolidBufferBeginDataPtrAccess(struct wlr_buffer* Buffer, uint32_t Flags, void** Data, uint32_t* Format, size_t* Stride)
+{
+	//Shared between every frame, nobody gets to write to it
+	if (Flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+		return false;
+
+	EshyWMSolidBuffer* Solid = wl_container_of(Buffer, Solid, Base);
+	*Data = &Solid->Pixel;
+	*Format = Solid->Format;
+	*Stride = sizeof(Solid->Pixel);
+	return true;
+}
+
+static void SolidBufferEndDataPtrAccess(struct wlr_buffer* Buffer)
+{}
+
+static const struct wlr_buffer_impl SolidBufferImpl = {
+	.destroy = SolidBufferDestroy,
+	.begin_data_ptr_access = SolidBufferBeginDataPtrAccess,
+	.end_data_ptr_access = SolidBufferEndDataPtrAccess,
+};
+
+//Normal and focused, created on first use
+static EshyWMSolidBuffer* SharedBuffers[2] = {nullptr, nullptr};
+
+static EshyWMSolidBuffer* GetSharedBuffer(bool bFocused)
+{
+	if (EshyWMSolidBuffer* Solid = SharedBuffers[bFocused])
+		return Solid;
+
+	const float* Color = bFocused ? EshyWMConfig::ESHYWM_COLOR_BORDER_FOCUSED : EshyWMConfig::ESHYWM_COLOR_BORDER_NORMAL;
+	const auto Channel = [](float Value) {return (uint32_t)std::lround(std::fmin(std::fmax(Value, 0.0f), 1.0f) * 255.0f);};
+
+	EshyWMSolidBuffer* Solid = new EshyWMSolidBuffer();
+	wlr_buffer_init(&Solid->Base, &SolidBufferImpl, 1, 1);
+	Solid->Pixel = (Channel(Color[3]) << 24) | (Channel(Color[0]) << 16) | (Channel(Color[1]) << 8) | Channel(Color[2]);
+	//Without an alpha channel the scene knows to skip whatever is underneath
+	Solid->Format = Color[3] >= 1.0f ? DRM_FORMAT_XRGB8888 : DRM_FORMAT_ARGB8888;
+
+	SharedBuffers[bFocused] = Solid;
+	return Solid;
+}
+
+EshyWMDecoration::EshyWMDecoration(struct wlr_scene_tree* Parent, int _Width, int _Height, bool _bFocused)
+	: Tree(nullptr)
+	, Edges{nullptr, nullptr, nullptr, nullptr}
+	, Width(-1)
+	, Height(-1)
+	, bFocused(_bFocused)
+{
+	Tree = wlr_scene_tree_create(Parent);
+	for (struct wlr_scene_buffer*& Edge : Edges)
+		Edge = wlr_scene_buffer_create(Tree, &GetSharedBuffer(bFocused)->Base);
+
+	//Behind the window's surfaces, sticking out by the border width on every side
+	wlr_scene_node_lower_to_bottom(&Tree->node);
+	wlr_scene_node_set_position(&Tree->node, -EshyWMConfig::ESHYWM_BORDER_WIDTH, -EshyWMConfig::ESHYWM_BORDER_WIDTH);
+
+	SetSize(_Width, _Height);
+}
+
+EshyWMDecoration::~EshyWMDecoration()
+{
+	wlr_scene_node_destroy(&Tree->node);
+}
+
+void EshyWMDecoration::SetSize(int _Width, int _Height)
+{
+	if (_Width == Width && _Height == Height)
+		return;
+
+	Width = _Width;
+	Height = _Height;
+
+	const int BorderWidth = EshyWMConfig::ESHYWM_BORDER_WIDTH;
+	const int FrameWidth = Width + 2 * BorderWidth;
+
+	//Top and bottom span the corners, left and right only the window's height
+	const struct wlr_box Boxes[4] = {
+		{0, 0, FrameWidth, BorderWidth},
+		{0, BorderWidth + Height, FrameWidth, BorderWidth},
+		{0, BorderWidth, BorderWidth, Height},
+		{BorderWidth + Width, BorderWidth, BorderWidth, Height},
+	};
+
+	const bool bOpaque = EshyWMConfig::ESHYWM_COLOR_BORDER_NORMAL[3] >= 1.0f && EshyWMConfig::ESHYWM_COLOR_BORDER_FOCUSED[3] >= 1.0f;
+	for (int i = 0; i < 4; ++i)
+	{
+		//A dest size of 0 would mean the buffer's own 1x1
+		wlr_scene_node_set_enabled(&Edges[i]->node, Boxes[i].width > 0 && Boxes[i].height > 0);
+		wlr_scene_node_set_position(&Edges[i]->node, Boxes[i].x, Boxes[i].y);
+		wlr_scene_buffer_set_dest_size(Edges[i], Boxes[i].width, Boxes[i].height);
+
+		//Lets the scene skip what is under the strip, never what is under the window
+		if (bOpaque)
+		{
+			pixman_region32_t Opaque;
+			pixman_region32_init_rect(&Opaque, 0, 0, Boxes[i].width, Boxes[i].height);
+			wlr_scene_buffer_set_opaque_region(Edges[i], &Opaque);
+			pixman_region32_fini(&Opaque);
+		}
+	}
+}
+
+void EshyWMDecoration::SetFocused(bool _bFocused)
+{
+	if (_bFocused == bFocused)
+		return;
+
+	bFocused = _bFocused;
+	for (struct wlr_scene_buffer* Edge : Edges)
+		wlr_scene_buffer_set_buffer(Edge, &GetSharedBuffer(bFocused)->Base);
+}
+
+void EshyWMDecoration::DestroySharedBuffers()
+{
+	for (EshyWMSolidBuffer*& Solid : SharedBuffers)
+		if (Solid)
+		{
+			wlr_buffer_drop(&Solid->Base);
+			Solid = nullptr;
+		}
+}
@@ -11,18 +11,22 @@ extern "C" {
 #include <wlr/util/log.h>
 }
 
-#include <nlohmann/json.hpp>
-
 #include <fstream>
 
 int EshybarShmID;
+EshyIPC::Channel<EshyWMMessage> EshybarSendChannel;
+EshyIPC::Channel<EshyWMMessage> EshybarReceiveChannel;
+int EventBroadcastShmID;
+EshyIPC::BroadcastChannel<EshyWMMessage> EventBroadcast;
+int WindowSnapshotShmID;
+EshyIPC::SnapshotWriter<EshyWMWindowSnapshot> WindowSnapshot;
 
 static std::ofstream LogFile;
 
 static void Callback(enum wlr_log_importance importance, const char *fmt, va_list args)
 {
 	char* log = (char*)malloc(10000 * sizeof(char));
-	vsprintf(log, fmt, args);
+	vsnprintf(log, 10000, fmt, args);
 	LogFile << log << "\n";
 	free(log);
 }
@@ -35,16 +39,56 @@ int main(int argc, char* argv[])
 	EshyWMConfig::InitializeKeys();
 	EshyWMConfig::ReadConfigFromFile("/home/eshy/eshywm/eshywm.conf");
 	
-	//Make shared memory for communication with Eshybar
-	EshybarShmID = EshyIPC::MakeSharedMemoryBlock("eshybarshm", 4096);
-	EshyIPC::AttachSharedMemoryBlock(EshybarShmID);
-	EshyIPC::InsertIntoMemory(EshybarShmID, "");
+	//Make shared memory for communication with Eshybar. Prefer an anonymous memfd that Eshybar inherits, SysV only if that is not available
+	EshybarShmID = EshyIPC::MakeSharedMemoryFd("eshybar", sizeof(eipcSharedSegment));
+	if(EshybarShmID < 0)
+		EshybarShmID = EshyIPC::MakeSharedMemoryBlock("eshybarshm", sizeof(eipcSharedSegment));
+
+	if(!EshyIPC::AttachSharedMemoryBlock(EshybarShmID).Block)
+	{
+		wlr_log(WLR_ERROR, "Failed to map the Eshybar shared memory block");
+		return 1;
+	}
+
+	EshyIPC::InitializeSegment(EshybarShmID);
+	EshyIPC::SetNotifier(EshybarShmID, EIPC_TO_CLIENT, EshyIPC::MakeNotifier());
+	EshyIPC::SetNotifier(EshybarShmID, EIPC_TO_COMPOSITOR, EshyIPC::MakeNotifier());
+	EshybarSendChannel.Open(EshybarShmID, EIPC_TO_CLIENT);
+	EshybarReceiveChannel.Open(EshybarShmID, EIPC_TO_COMPOSITOR);
+
+	EventBroadcastShmID = EshyIPC::MakeSharedMemoryFd("eshywm-events", sizeof(eipcBroadcastRing));
+	if(EventBroadcastShmID < 0)
+		EventBroadcastShmID = EshyIPC::MakeSharedMemoryBlock("eshywmeventsshm", sizeof(eipcBroadcastRing));
+
+	if(!EshyIPC::AttachSharedMemoryBlock(EventBroadcastShmID).Block)
+	{
+		wlr_log(WLR_ERROR, "Failed to map the event broadcast shared memory block");
+		return 1;
+	}
+
+	EshyIPC::InitializeBroadcast(EventBroadcastShmID);
+	EventBroadcast.Open(EventBroadcastShmID);
+
+	WindowSnapshotShmID = EshyIPC::MakeSharedMemoryFd("eshywm-windows", sizeof(EshyWMWindowSnapshot));
+	if(WindowSnapshotShmID < 0)
+		WindowSnapshotShmID = EshyIPC::MakeSharedMemoryBlock("eshywmwindowsshm", sizeof(EshyWMWindowSnapshot));
+
+	if(!WindowSnapshot.Open(WindowSnapshotShmID))
+	{
+		wlr_log(WLR_ERROR, "Failed to map the window snapshot shared memory block");
+		return 1;
+	}
 
 	Server = new EshyWMServer;
 	Server->BeginEventLoop();
 	Server->Shutdown();
 
+	EshyIPC::DetachSharedMemoryBlock(EventBroadcastShmID);
+	EshyIPC::DestroySharedMemoryBlock(EventBroadcastShmID);
+	WindowSnapshot.Close();
+	EshyIPC::DestroySharedMemoryBlock(WindowSnapshotShmID);
 	EshyIPC::DetachSharedMemoryBlock(EshybarShmID);
+	EshyIPC::DestroySharedMemoryBlock(EshybarShmID);
 	LogFile.close();
 	return 0;
 }
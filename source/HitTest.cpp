@@ -0,0 +1,339 @@
+#include "HitTest.h"
+#include "Window.h"
+#include "Output.h"
+#include "Switcher.h"
+#include "SpecialWindow.h"
+#include "Config.h"
+#include "Workspace.h"
+
+#define static
+
+extern "C"
+{
+#include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+}
+
+#undef static
+
+#include <algorithm>
+#include <time.h>
+
+//Whether A is drawn above B, the same order wlr_scene_node_at visits them in
+static bool IsAbove(const EshyWMWindowBase* A, const EshyWMWindowBase* B)
+{
+	return A->HitLayer != B->HitLayer ? A->HitLayer > B->HitLayer : A->StackSerial > B->StackSerial;
+}
+
+EshyWMHitTester::EshyWMHitTester()
+	: HitTests(0)
+	, CacheHits(0)
+	, SceneFallbacks(0)
+	, LastGrid(0)
+	, Generation(0)
+	, StackCounter(0)
+	, PopupCount(0)
+	, CachedWindow(nullptr)
+	, CachedSurface(nullptr)
+	, CachedX(0)
+	, CachedY(0)
+	, CachedGeneration(0)
+	, CachedGrid(0)
+	, CachedCell(0)
+	, CurrentSecond(0)
+	, HitTestsThisSecond(0)
+	, HitTestsLastSecond(0)
+{}
+
+void EshyWMHitTester::UpdateWindow(EshyWMWindowBase* Window)
+{
+	//Minimized windows and those on hidden workspaces are disabled themselves or through their workspace's tree
+	struct wlr_surface* Surface = Window->GetSurface();
+	int LayoutX;
+	int LayoutY;
+	if (!Window->Scene || !wlr_scene_node_coords(&Window->Scene->node, &LayoutX, &LayoutY) || !Surface || !Surface->mapped)
+	{
+		RemoveWindow(Window);
+		return;
+	}
+
+	//Everything that can be hit, the surface with its subsurfaces and the frame around it
+	const int BorderWidth = EshyWMConfig::ESHYWM_BORDER_WIDTH;
+	struct wlr_box Box;
+	wlr_surface_get_extends(Surface, &Box);
+	const int Right = std::max(Box.x + Box.width, Window->WindowGeometry.width + BorderWidth);
+	const int Bottom = std::max(Box.y + Box.height, Window->WindowGeometry.height + BorderWidth);
+	Box.x = std::min(Box.x, -BorderWidth);
+	Box.y = std::min(Box.y, -BorderWidth);
+	Box.width = Right - Box.x;
+	Box.height = Bottom - Box.y;
+
+	Box.x += LayoutX;
+	Box.y += LayoutY;
+
+	//Workspace trees sit between windows and their layer
+	int Layer = 0;
+	for (struct wlr_scene_tree* Tree = Window->Scene->node.parent; Tree; Tree = Tree->node.parent)
+		for (int i = 0; i < L_NUM_LAYERS; ++i)
+			if (Tree == Server->Layers[i])
+				Layer = i;
+
+	if (Window->bHitIndexed && wlr_box_equal(&Box, &Window->HitBox) && Layer == Window->HitLayer)
+		return;
+
+	if (Window->bHitIndexed)
+		Unindex(Window);
+	else
+		//A newly mapped window's scene node is created on top of its layer
+		Window->StackSerial = ++StackCounter;
+
+	Window->HitBox = Box;
+	Window->HitLayer = Layer;
+	Index(Window);
+	Generation++;
+}
+
+void EshyWMHitTester::RemoveWindow(EshyWMWindowBase* Window)
+{
+	if (Window == CachedWindow)
+		CachedWindow = nullptr;
+
+	if (!Window->bHitIndexed)
+		return;
+
+	Unindex(Window);
+	Generation++;
+}
+
+void EshyWMHitTester::WindowRaised(EshyWMWindowBase* Window)
+{
+	Window->StackSerial = ++StackCounter;
+	Generation++;
+}
+
+void EshyWMHitTester::WindowCommitted(EshyWMWindowBase* Window)
+{
+	//The cached surface's input region or subsurfaces may have changed under it
+	if (Window == CachedWindow)
+		Generation++;
+
+	UpdateWindow(Window);
+}
+
+void EshyWMHitTester::RebuildOutputs()
+{
+	Grids.clear();
+	LastGrid = 0;
+
+	for (EshyWMOutput* Output : Server->OutputList)
+	{
+		OutputGrid Grid;
+		wlr_output_layout_get_box(Server->OutputLayout, Output->WlrOutput, &Grid.Box);
+		if (wlr_box_empty(&Grid.Box))
+			continue;
+
+		Grid.Columns = (Grid.Box.width + HIT_GRID_CELL_SIZE - 1) / HIT_GRID_CELL_SIZE;
+		Grid.Rows = (Grid.Box.height + HIT_GRID_CELL_SIZE - 1) / HIT_GRID_CELL_SIZE;
+		Grid.Cells.resize(Grid.Columns * Grid.Rows);
+		Grids.push_back(std::move(Grid));
+	}
+
+	for (EshyWMWindowBase* Window : Server->WindowList)
+		if (Window->bHitIndexed)
+			Index(Window);
+
+	Generation++;
+}
+
+void EshyWMHitTester::PopupCreated()
+{
+	PopupCount++;
+	Generation++;
+}
+
+void EshyWMHitTester::PopupDestroyed()
+{
+	PopupCount--;
+	Generation++;
+
+	//Popups can move their parent window, catch up once the last one is gone
+	if (PopupCount == 0)
+		for (EshyWMWindowBase* Window : Server->WindowList)
+			UpdateWindow(Window);
+}
+
+EshyWMWindowBase* EshyWMHitTester::WindowAt(double lx, double ly, struct wlr_surface** surface, double* sx, double* sy)
+{
+	CountHitTest();
+
+	if (PopupCount > 0 || Server->Switcher->IsActive())
+	{
+		SceneFallbacks++;
+		CachedWindow = nullptr;
+		return DesktopWindowAt(lx, ly, surface, sx, sy);
+	}
+
+	//Eshybar is above every window but fullscreen ones and is a single small tree
+	EshyWMOutput* Primary = Server->GetPrimaryOutput();
+	if (Server->Eshybar && !(Primary && Primary->ActiveWorkspace && Primary->ActiveWorkspace->HasFullscreenWindow()))
+		if (struct wlr_scene_node* Node = wlr_scene_node_at(&Server->Eshybar->SceneTree->node, lx, ly, sx, sy))
+		{
+			CachedWindow = nullptr;
+			return WindowFromNode(Node, surface);
+		}
+
+	OutputGrid* Grid = FindGrid(lx, ly);
+	if (!Grid)
+	{
+		CachedWindow = nullptr;
+		return nullptr;
+	}
+
+	const int Cell = GetCell(*Grid, lx, ly);
+
+	//The cached surface only wins if nothing above it in the cell could be at the point, which a higher window's box rules out
+	if (CachedWindow && CachedGeneration == Generation && &Grids[CachedGrid] == Grid && CachedCell == Cell
+		&& wlr_surface_point_accepts_input(CachedSurface, lx - CachedX, ly - CachedY)
+		&& std::none_of(Grid->Cells[Cell].begin(), Grid->Cells[Cell].end(), [this, lx, ly](const EshyWMWindowBase* Window)
+		{
+			return IsAbove(Window, CachedWindow) && wlr_box_contains_point(&Window->HitBox, lx, ly);
+		}))
+	{
+		CacheHits++;
+		*surface = CachedSurface;
+		*sx = lx - CachedX;
+		*sy = ly - CachedY;
+		return CachedWindow;
+	}
+
+	CachedWindow = nullptr;
+
+	Candidates.clear();
+	for (EshyWMWindowBase* Window : Grid->Cells[Cell])
+		if (wlr_box_contains_point(&Window->HitBox, lx, ly))
+			Candidates.push_back(Window);
+
+	//Topmost first, the same order wlr_scene_node_at would visit them in
+	std::sort(Candidates.begin(), Candidates.end(), IsAbove);
+
+	for (EshyWMWindowBase* Candidate : Candidates)
+	{
+		struct wlr_scene_node* Node = wlr_scene_node_at(&Candidate->Scene->node, lx, ly, sx, sy);
+		if (!Node)
+			continue;
+
+		/*Only a root surface without subsurfaces stacked above it is cached, subsurfaces can be destroyed without the window hearing
+		*  about it and could cover the root where accepts_input alone would not notice*/
+		EshyWMWindowBase* Window = WindowFromNode(Node, surface);
+		if (Window && *surface == Window->GetSurface() && wl_list_empty(&(*surface)->current.subsurfaces_above))
+		{
+			CachedWindow = Window;
+			CachedSurface = *surface;
+			wlr_scene_node_coords(Node, &CachedX, &CachedY);
+			CachedGeneration = Generation;
+			CachedGrid = Grid - Grids.data();
+			CachedCell = Cell;
+		}
+
+		return Window;
+	}
+
+	return nullptr;
+}
+
+uint64_t EshyWMHitTester::GetHitTestsPerSecond() const
+{
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &Now);
+
+	//The last full second, or the current one if it just ended and nothing has been counted since
+	if (Now.tv_sec == CurrentSecond)
+		return HitTestsLastSecond;
+
+	return Now.tv_sec == CurrentSecond + 1 ? HitTestsThisSecond : 0;
+}
+
+template<typename Function>
+void EshyWMHitTester::ForEachCell(const struct wlr_box& Box, Function Fn)
+{
+	for (OutputGrid& Grid : Grids)
+	{
+		struct wlr_box Overlap;
+		if (!wlr_box_intersection(&Overlap, &Box, &Grid.Box))
+			continue;
+
+		const int FirstColumn = (Overlap.x - Grid.Box.x) / HIT_GRID_CELL_SIZE;
+		const int LastColumn = (Overlap.x + Overlap.width - 1 - Grid.Box.x) / HIT_GRID_CELL_SIZE;
+		const int FirstRow = (Overlap.y - Grid.Box.y) / HIT_GRID_CELL_SIZE;
+		const int LastRow = (Overlap.y + Overlap.height - 1 - Grid.Box.y) / HIT_GRID_CELL_SIZE;
+
+		for (int Row = FirstRow; Row <= LastRow; ++Row)
+			for (int Column = FirstColumn; Column <= LastColumn; ++Column)
+				Fn(Grid.Cells[Row * Grid.Columns + Column]);
+	}
+}
+
+void EshyWMHitTester::Index(EshyWMWindowBase* Window)
+{
+	ForEachCell(Window->HitBox, [Window](std::vector<EshyWMWindowBase*>& Cell)
+	{
+		Cell.push_back(Window);
+	});
+
+	Window->bHitIndexed = true;
+}
+
+void EshyWMHitTester::Unindex(EshyWMWindowBase* Window)
+{
+	ForEachCell(Window->HitBox, [Window](std::vector<EshyWMWindowBase*>& Cell)
+	{
+		std::vector<EshyWMWindowBase*>::iterator it = std::find(Cell.begin(), Cell.end(), Window);
+		if (it != Cell.end())
+		{
+			*it = Cell.back();
+			Cell.pop_back();
+		}
+	});
+
+	Window->bHitIndexed = false;
+}
+
+int EshyWMHitTester::GetCell(const OutputGrid& Grid, double lx, double ly)
+{
+	const int Column = std::min(((int)lx - Grid.Box.x) / HIT_GRID_CELL_SIZE, Grid.Columns - 1);
+	const int Row = std::min(((int)ly - Grid.Box.y) / HIT_GRID_CELL_SIZE, Grid.Rows - 1);
+	return Row * Grid.Columns + Column;
+}
+
+EshyWMHitTester::OutputGrid* EshyWMHitTester::FindGrid(double lx, double ly)
+{
+	//The cursor usually stays on the same output
+	if (LastGrid < Grids.size() && wlr_box_contains_point(&Grids[LastGrid].Box, lx, ly))
+		return &Grids[LastGrid];
+
+	for (size_t i = 0; i < Grids.size(); ++i)
+		if (wlr_box_contains_point(&Grids[i].Box, lx, ly))
+		{
+			LastGrid = i;
+			return &Grids[i];
+		}
+
+	return nullptr;
+}
+
+void EshyWMHitTester::CountHitTest()
+{
+	HitTests++;
+
+	struct timespec Now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &Now);
+	if (Now.tv_sec != CurrentSecond)
+	{
+		HitTestsLastSecond = Now.tv_sec == CurrentSecond + 1 ? HitTestsThisSecond : 0;
+		HitTestsThisSecond = 0;
+		CurrentSecond = Now.tv_sec;
+	}
+
+	HitTestsThisSecond++;
+}
@@ -0,0 +1,503 @@
+#include "IPCServer.h"
+#include "Server.h"
+#include "Window.h"
+#include "Output.h"
+#include "HitTest.h"
+#include "TileLayout.h"
+#include "Workspace.h"
+#include "Config.h"
+#include "Util.h"
+
+#define static
+#define class wlr
+
+extern "C"
+{
+#include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xdg_shell.h>
+#include <wlr/util/log.h>
+}
+
+#undef static
+#undef class
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char* ActionName(EEshyWMAction Action)
+{
+	switch (Action)
+	{
+	case ACTION_ADD_WINDOW:			return "add";
+	case ACTION_REMOVE_WINDOW:		return "remove";
+	case ACTION_FOCUS_WINDOW:		return "focus";
+	case ACTION_UNFOCUS_WINDOW:		return "unfocus";
+	case ACTION_MINIMIZE_WINDOW:	return "minimize";
+	case ACTION_UPDATE_WINDOW:		return "update";
+	default:						return "unknown";
+	}
+}
+
+static const char* WindowStateName(EEshyWMWindowState State)
+{
+	switch (State)
+	{
+	case ESHYWM_WINDOW_STATE_MINIMIZED:		return "minimized";
+	case ESHYWM_WINDOW_STATE_MAXIMIZED:		return "maximized";
+	case ESHYWM_WINDOW_STATE_FULLSCREEN:	return "fullscreen";
+	default:								return "normal";
+	}
+}
+
+//Ids from clients are untrusted, stale or made up handles resolve to nothing
+static EshyWMWindowBase* FindWindow(uint64_t WindowID)
+{
+	return Server->Windows.Get(WindowID);
+}
+
+static nlohmann::json WindowToJson(EshyWMWindowBase* Window)
+{
+	nlohmann::json Info;
+	Info["id"] = Window->Handle;
+	Info["app_id"] = Window->GetAppID();
+	Info["title"] = Window->GetTitle();
+	Info["state"] = WindowStateName(Window->WindowState);
+	Info["focused"] = Server->FocusedWindow == Window;
+	Info["x"] = Window->Scene ? Window->Scene->node.x : 0;
+	Info["y"] = Window->Scene ? Window->Scene->node.y : 0;
+	Info["width"] = Window->WindowGeometry.width;
+	Info["height"] = Window->WindowGeometry.height;
+	Info["workspace"] = Window->Workspace ? Window->Workspace->Index : -1;
+	return Info;
+}
+
+static nlohmann::json OutputToJson(EshyWMOutput* Output)
+{
+	struct wlr_box Box;
+	wlr_output_layout_get_box(Server->OutputLayout, Output->WlrOutput, &Box);
+
+	nlohmann::json Info;
+	Info["name"] = Output->WlrOutput->name;
+	Info["enabled"] = Output->WlrOutput->enabled;
+	Info["x"] = Box.x;
+	Info["y"] = Box.y;
+	Info["width"] = Output->WlrOutput->width;
+	Info["height"] = Output->WlrOutput->height;
+	Info["refresh"] = Output->WlrOutput->refresh;
+	Info["scale"] = Output->WlrOutput->scale;
+	Info["adaptive_sync"] = Output->WlrOutput->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+	Info["workspace"] = Output->ActiveWorkspace ? Output->ActiveWorkspace->Index : -1;
+	Info["max_render_time"] = Output->MaxRenderTime == ESHYWM_MAX_RENDER_TIME_AUTO ? nlohmann::json("auto") : nlohmann::json(Output->MaxRenderTime);
+	Info["render_budget_ms"] = Output->GetRenderBudget();
+	Info["render_time_us"] = Output->RenderTimeNs / 1000;
+	Info["peak_render_time_us"] = Output->PeakRenderTimeNs / 1000;
+	Info["late_frames"] = Output->LateFrames;
+	Info["direct_scanout"] = Output->bDirectScanout;
+	Info["direct_scanout_frames"] = Output->DirectScanoutFrames;
+	Info["composited_frames"] = Output->CompositedFrames;
+	Info["usable_area"] = {{"x", Output->UsableArea.x}, {"y", Output->UsableArea.y}, {"width", Output->UsableArea.width}, {"height", Output->UsableArea.height}};
+	return Info;
+}
+
+static nlohmann::json HistogramToJson(const EshyWMHistogram& Histogram)
+{
+	//Only the buckets that were hit, as [largest value, count]
+	nlohmann::json Buckets = nlohmann::json::array();
+	for (int i = 0; i < EshyWMHistogram::BucketCount; ++i)
+		if (const uint64_t Count = Histogram.GetBucketCount(i))
+			Buckets.push_back({EshyWMHistogram::GetBucketLimit(i), Count});
+
+	const uint64_t Count = Histogram.GetCount();
+	nlohmann::json Info;
+	Info["count"] = Count;
+	Info["mean"] = Count ? (double)Histogram.GetSum() / Count : 0.0;
+	Info["max"] = Histogram.GetMax();
+	Info["p50"] = Histogram.GetPercentile(0.5);
+	Info["p90"] = Histogram.GetPercentile(0.9);
+	Info["p99"] = Histogram.GetPercentile(0.99);
+	Info["buckets"] = Buckets;
+	return Info;
+}
+
+static nlohmann::json FrameStatsToJson()
+{
+	nlohmann::json Outputs = nlohmann::json::array();
+	for (EshyWMOutput* Output : Server->OutputList)
+	{
+		nlohmann::json Info;
+		Info["name"] = Output->WlrOutput->name;
+		Info["refresh"] = Output->WlrOutput->refresh;
+		Info["present_refresh_ns"] = Output->PresentRefreshNs;
+		Info["missed_vblanks_total"] = Output->MissedVblankTotal;
+		Info["frame_to_commit_ns"] = HistogramToJson(Output->FrameToCommitNs);
+		Info["commit_ns"] = HistogramToJson(Output->CommitNs);
+		Info["frame_interval_ns"] = HistogramToJson(Output->FrameIntervalNs);
+		Info["missed_vblanks"] = HistogramToJson(Output->MissedVblanks);
+		Info["damaged_pixels"] = HistogramToJson(Output->DamagedPixels);
+		Outputs.push_back(Info);
+	}
+
+	return Outputs;
+}
+
+static nlohmann::json MakeError(const std::string& Error)
+{
+	return {{"success", false}, {"error", Error}};
+}
+
+static nlohmann::json ExecuteCommand(EshyWMIPCClient* Client, const nlohmann::json& Request)
+{
+	if (!Request.is_object() || !Request.contains("command") || !Request["command"].is_string())
+		return MakeError("request must be an object with a command");
+
+	const std::string Command = Request["command"];
+
+	if (Command == "get_windows")
+	{
+		nlohmann::json Windows = nlohmann::json::array();
+		for (EshyWMWindowBase* Window : Server->WindowList)
+			Windows.push_back(WindowToJson(Window));
+
+		return {{"success", true}, {"windows", Windows}};
+	}
+	else if (Command == "get_outputs")
+	{
+		nlohmann::json Outputs = nlohmann::json::array();
+		for (EshyWMOutput* Output : Server->OutputList)
+			Outputs.push_back(OutputToJson(Output));
+
+		return {{"success", true}, {"outputs", Outputs}};
+	}
+	else if (Command == "get_stats")
+	{
+		nlohmann::json Stats;
+		Stats["metadata_updates_emitted"] = Server->MetadataUpdatesEmitted;
+		Stats["metadata_updates_coalesced"] = Server->MetadataUpdatesCoalesced;
+		Stats["metadata_updates_pending"] = Server->MetadataDirtyWindows.size();
+		Stats["hit_tests"] = Server->HitTester->HitTests;
+		Stats["hit_tests_per_second"] = Server->HitTester->GetHitTestsPerSecond();
+		Stats["hit_test_cache_hits"] = Server->HitTester->CacheHits;
+		Stats["hit_test_scene_fallbacks"] = Server->HitTester->SceneFallbacks;
+		Stats["grab_motion_events"] = Server->GrabMotionEvents;
+		Stats["grab_motion_applied"] = Server->GrabMotionApplied;
+		Stats["resize_configures_sent"] = Server->ResizeConfiguresSent;
+		Stats["resize_configures_committed"] = Server->ResizeConfiguresCommitted;
+
+		uint64_t TiledWindows = 0;
+		uint64_t TileNodesLaidOut = 0;
+		for (EshyWMOutput* Output : Server->OutputList)
+			for (EshyWMWorkspace* Workspace : Output->Workspaces)
+			{
+				TiledWindows += Workspace->TileLayout->GetLeafCount();
+				TileNodesLaidOut += Workspace->TileLayout->GetNodesLaidOut();
+			}
+		Stats["tiled_windows"] = TiledWindows;
+		Stats["tile_nodes_laid_out"] = TileNodesLaidOut;
+		return {{"success", true}, {"stats", Stats}};
+	}
+	else if (Command == "get_frame_stats")
+	{
+		return {{"success", true}, {"outputs", FrameStatsToJson()}};
+	}
+	else if (Command == "switch_workspace")
+	{
+		if (!Request.contains("workspace") || !Request["workspace"].is_number_integer())
+			return MakeError("switch_workspace needs a workspace index");
+
+		//The output under the cursor unless one is given
+		EshyWMWorkspace* Current = Server->GetCurrentWorkspace();
+		EshyWMOutput* Output = Current ? Current->Output : nullptr;
+		if (Request.contains("output") && Request["output"].is_number_unsigned())
+			Output = Request["output"] < Server->OutputList.size() ? Server->OutputList[Request["output"]] : nullptr;
+
+		const int Index = Request["workspace"];
+		if (!Output || Index < 0 || Index >= (int)Output->Workspaces.size())
+			return MakeError("no such workspace");
+
+		Server->SwitchWorkspace(Output, Index);
+		return {{"success", true}};
+	}
+	else if (Command == "subscribe")
+	{
+		Client->bSubscribed = true;
+		return {{"success", true}};
+	}
+
+	//Everything else acts on a window
+	EshyWMWindowBase* Window = Request.contains("id") && Request["id"].is_number_unsigned() ? FindWindow(Request["id"]) : nullptr;
+	if (!Window)
+		return MakeError("unknown window id");
+
+	//Closing is the only thing that makes sense before the client has shown anything
+	if (Command != "close_window" && !Window->IsMapped())
+		return MakeError("window is not mapped");
+
+	const bool bEnable = Request.contains("enable") && Request["enable"].is_boolean() ? (bool)Request["enable"] : true;
+
+	if (Command == "focus_window")
+		Window->FocusWindow();
+	else if (Command == "close_window")
+		Server->CloseWindow(Window);
+	else if (Command == "minimize_window")
+		Window->MinimizeWindow(bEnable);
+	else if (Command == "maximize_window")
+		Window->MaximizeWindow(bEnable);
+	else if (Command == "fullscreen_window")
+		Window->FullscreenWindow(bEnable);
+	else if (Command == "move_to_workspace")
+	{
+		const int Index = Request.contains("workspace") && Request["workspace"].is_number_integer() ? (int)Request["workspace"] : -1;
+		if (!Window->Workspace || Index < 0 || Index >= (int)Window->Workspace->Output->Workspaces.size())
+			return MakeError("no such workspace");
+
+		Server->MoveWindowToWorkspace(Window, Window->Workspace->Output->Workspaces[Index]);
+	}
+	else
+		return MakeError("unknown command " + Command);
+
+	return {{"success", true}};
+}
+
+static std::string FrameMessage(const std::string& Payload)
+{
+	const uint32_t Length = Payload.size();
+	std::string Message((const char*)&Length, sizeof(Length));
+	Message += Payload;
+	return Message;
+}
+
+
+EshyWMIPCServer::EshyWMIPCServer(struct wl_event_loop* _EventLoop)
+	: EventLoop(_EventLoop)
+	, ListenSource(nullptr)
+	, ListenFd(-1)
+	, bReapScheduled(false)
+{}
+
+EshyWMIPCServer::~EshyWMIPCServer()
+{
+	while (!Clients.empty())
+		DisconnectClient(Clients.back());
+
+	if (ListenSource)
+		wl_event_source_remove(ListenSource);
+
+	if (ListenFd >= 0)
+	{
+		close(ListenFd);
+		unlink(SocketPath.c_str());
+	}
+}
+
+bool EshyWMIPCServer::Start(const std::string& _SocketPath)
+{
+	SocketPath = _SocketPath;
+
+	struct sockaddr_un Address = {};
+	Address.sun_family = AF_UNIX;
+	if (SocketPath.size() >= sizeof(Address.sun_path))
+		return false;
+
+	strcpy(Address.sun_path, SocketPath.c_str());
+
+	ListenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (ListenFd < 0)
+		return false;
+
+	unlink(SocketPath.c_str());
+	if (bind(ListenFd, (struct sockaddr*)&Address, sizeof(Address)) < 0 || listen(ListenFd, 16) < 0)
+	{
+		wlr_log(WLR_ERROR, "Failed to open IPC socket %s: %s", SocketPath.c_str(), strerror(errno));
+		close(ListenFd);
+		ListenFd = -1;
+		return false;
+	}
+
+	ListenSource = wl_event_loop_add_fd(EventLoop, ListenFd, WL_EVENT_READABLE, IPCServerSocketReady, this);
+	return true;
+}
+
+void EshyWMIPCServer::AcceptClient()
+{
+	int ClientFd;
+	while ((ClientFd = accept4(ListenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+	{
+		EshyWMIPCClient* Client = new EshyWMIPCClient(ClientFd);
+		Client->EventSource = wl_event_loop_add_fd(EventLoop, ClientFd, WL_EVENT_READABLE, IPCClientSocketReady, Client);
+		Clients.push_back(Client);
+	}
+}
+
+void EshyWMIPCServer::DisconnectClient(EshyWMIPCClient* Client)
+{
+	wl_event_source_remove(Client->EventSource);
+	close(Client->Fd);
+
+	Clients.erase(std::remove(Clients.begin(), Clients.end(), Client), Clients.end());
+	delete Client;
+}
+
+bool EshyWMIPCServer::ReadFromClient(EshyWMIPCClient* Client)
+{
+	char Buffer[4096];
+	ssize_t Read;
+	while ((Read = recv(Client->Fd, Buffer, sizeof(Buffer), 0)) > 0)
+		Client->InputBuffer.append(Buffer, Read);
+
+	//Orderly shutdown or a real error
+	if (Read == 0 || (Read < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+		return false;
+
+	while (Client->InputBuffer.size() >= sizeof(uint32_t))
+	{
+		uint32_t Length;
+		memcpy(&Length, Client->InputBuffer.data(), sizeof(Length));
+		if (Length > ESHYWM_IPC_MAX_MESSAGE_SIZE)
+			return false;
+
+		if (Client->InputBuffer.size() < sizeof(Length) + Length)
+			break;
+
+		const nlohmann::json Request = nlohmann::json::parse(Client->InputBuffer.begin() + sizeof(Length), Client->InputBuffer.begin() + sizeof(Length) + Length, nullptr, false);
+		Client->InputBuffer.erase(0, sizeof(Length) + Length);
+
+		nlohmann::json Reply;
+		if (Request.is_discarded())
+			Reply = MakeError("invalid json");
+		else if (Request.is_array())
+		{
+			//Every command of a batch runs inside this dispatch, so the scene is only committed once with all of their changes
+			Reply = nlohmann::json::array();
+			for (const nlohmann::json& Command : Request)
+				Reply.push_back(ExecuteCommand(Client, Command));
+		}
+		else
+			Reply = ExecuteCommand(Client, Request);
+
+		QueueMessage(Client, Reply.dump());
+	}
+
+	return Client->OutputBuffer.size() <= ESHYWM_IPC_MAX_OUTPUT_BUFFER_SIZE;
+}
+
+bool EshyWMIPCServer::WriteToClient(EshyWMIPCClient* Client)
+{
+	while (!Client->OutputBuffer.empty())
+	{
+		const ssize_t Written = send(Client->Fd, Client->OutputBuffer.data(), Client->OutputBuffer.size(), MSG_NOSIGNAL);
+		if (Written < 0)
+		{
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+
+			return false;
+		}
+
+		Client->OutputBuffer.erase(0, Written);
+	}
+
+	//Only wait for writability while there is something left to send
+	wl_event_source_fd_update(Client->EventSource, Client->OutputBuffer.empty() ? WL_EVENT_READABLE : WL_EVENT_READABLE | WL_EVENT_WRITABLE);
+	return true;
+}
+
+void EshyWMIPCServer::QueueMessage(EshyWMIPCClient* Client, const std::string& Payload)
+{
+	const bool bWasEmpty = Client->OutputBuffer.empty();
+	Client->OutputBuffer += FrameMessage(Payload);
+
+	if (bWasEmpty)
+		WriteToClient(Client);
+}
+
+void EshyWMIPCServer::BroadcastWindowEvent(const EshyWMMessage& Message)
+{
+	nlohmann::json Event;
+	Event["event"] = "window";
+	Event["action"] = ActionName(Message.Action);
+	Event["id"] = Message.WindowID;
+	if (Message.Action == ACTION_ADD_WINDOW || Message.Action == ACTION_UPDATE_WINDOW)
+	{
+		Event["app_id"] = Message.AppID;
+		Event["title"] = Message.Title;
+	}
+
+	const std::string Payload = Event.dump();
+
+	/*A subscriber that stops reading must never stall the compositor, stop queueing once its buffer is full and drop it after this dispatch.
+	*  It can reconnect and resync with get_windows.*/
+	for (EshyWMIPCClient* Client : Clients)
+	{
+		if (!Client->bSubscribed || Client->bOverflowed)
+			continue;
+
+		QueueMessage(Client, Payload);
+		if (Client->OutputBuffer.size() > ESHYWM_IPC_MAX_OUTPUT_BUFFER_SIZE)
+		{
+			Client->bOverflowed = true;
+			if (!bReapScheduled)
+			{
+				wl_event_loop_add_idle(EventLoop, IPCServerReapClients, this);
+				bReapScheduled = true;
+			}
+		}
+	}
+}
+
+void EshyWMIPCServer::ReapOverflowedClients()
+{
+	bReapScheduled = false;
+
+	std::vector<EshyWMIPCClient*> Overflowed;
+	std::copy_if(Clients.begin(), Clients.end(), std::back_inserter(Overflowed), [](EshyWMIPCClient* Client) {return Client->bOverflowed;});
+
+	for (EshyWMIPCClient* Client : Overflowed)
+		DisconnectClient(Client);
+}
+
+
+int IPCServerSocketReady(int fd, uint32_t mask, void* data)
+{
+	EshyWMIPCServer* IPCServer = (EshyWMIPCServer*)data;
+	IPCServer->AcceptClient();
+	return 0;
+}
+
+void IPCServerReapClients(void* data)
+{
+	EshyWMIPCServer* IPCServer = (EshyWMIPCServer*)data;
+	IPCServer->ReapOverflowedClients();
+}
+
+int IPCClientSocketReady(int fd, uint32_t mask, void* data)
+{
+	EshyWMIPCClient* Client = (EshyWMIPCClient*)data;
+
+	bool bKeepClient = !(mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR));
+	if (bKeepClient && (mask & WL_EVENT_READABLE))
+		bKeepClient = Server->IPCServer->ReadFromClient(Client);
+	if (bKeepClient && (mask & WL_EVENT_WRITABLE))
+		bKeepClient = Server->IPCServer->WriteToClient(Client);
+
+	if (!bKeepClient)
+		Server->IPCServer->DisconnectClient(Client);
+
+	return 0;
+}
+
+void EshyWMIPCServer::DumpFrameStats()
+{
+	//One line per output, the log callback has a fixed size buffer
+	for (const nlohmann::json& Output : FrameStatsToJson())
+		wlr_log(WLR_INFO, "Frame stats: %s", Output.dump().c_str());
+}
@@ -3,6 +3,9 @@
 #include "Server.h"
 #include "Window.h"
 #include "Config.h"
+#include "Switcher.h"
+#include "Workspace.h"
+#include "Output.h"
 
 #define static
 
@@ -62,7 +65,19 @@ bool HandleKeybinding(xkb_keysym_t sym)
 	}
 	else if (EshyWMConfig::GetKeyboundCommands().find(sym) != EshyWMConfig::GetKeyboundCommands().end())
 	{
-		system(EshyWMConfig::GetKeyboundCommands()[sym].c_str());
+		Server->RunCommand(EshyWMConfig::GetKeyboundCommands()[sym]);
+	}
+	else if (sym >= XKB_KEY_1 && sym < XKB_KEY_1 + ESHYWM_WORKSPACE_COUNT)
+	{
+		EshyWMWorkspace* Current = Server->GetCurrentWorkspace();
+		if (!Current)
+			return true;
+
+		//With the window modifier held the focused window is sent there instead
+		if (Server->bWindowModifierKeyPressed && Server->FocusedWindow && Server->FocusedWindow->Workspace)
+			Server->MoveWindowToWorkspace(Server->FocusedWindow, Server->FocusedWindow->Workspace->Output->Workspaces[sym - XKB_KEY_1]);
+		else
+			Server->SwitchWorkspace(Current->Output, sym - XKB_KEY_1);
 	}
 	else
 		return false;
@@ -108,24 +123,30 @@ void KeyboardHandleKey(struct wl_listener* listener, void* data)
 	if (!handled && (modifiers & WLR_MODIFIER_ALT) && event->state == WL_KEYBOARD_KEY_STATE_PRESSED)
 	{
 		for (int i = 0; i < nsyms; i++)
-			if (syms[i] == XKB_KEY_Tab)
-			{				
-				Server->NextWindowIndex++;
-				if (Server->NextWindowIndex > Server->WindowList.size() - 1)
-					Server->NextWindowIndex = 0;
+			if (syms[i] == XKB_KEY_Tab || syms[i] == XKB_KEY_ISO_Left_Tab)
+			{
+				//Step through the focus order, the first step lands on the window focused before the current one
+				if (modifiers & WLR_MODIFIER_SHIFT)
+					Server->Switcher->Previous();
+				else
+					Server->Switcher->Next();
 
 				handled = true;
 				break;
 			}
+			else if (syms[i] == XKB_KEY_Escape && Server->Switcher->IsActive())
+			{
+				Server->Switcher->Cancel();
+				handled = true;
+				break;
+			}
 	}
 	else if (!handled && event->state == WL_KEYBOARD_KEY_STATE_RELEASED)
 	{
 		for (int i = 0; i < nsyms; i++)
-			if (syms[i] == XKB_KEY_Alt_L)
-			{				
-				EshyWMWindowBase* next_window = Server->WindowList[Server->NextWindowIndex];
-				next_window->FocusWindow();
-				Server->NextWindowIndex = 0;
+			if (syms[i] == XKB_KEY_Alt_L && Server->Switcher->IsActive())
+			{
+				Server->Switcher->Commit();
 				handled = true;
 				break;
 			}
@@ -2,6 +2,8 @@
 #include "Output.h"
 #include "Server.h"
 #include "EshyWM.h"
+#include "Workspace.h"
+#include "Config.h"
 
 #include "EshyIPC.h"
 
@@ -9,6 +11,7 @@
 
 extern "C"
 {
+#include <wlr/backend.h>
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_scene.h>
 }
@@ -17,34 +20,157 @@ extern "C"
 
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <time.h>
 
-static eipcSharedMemory SharedMemory;
-static std::string CurrentShm;
+//Headroom on top of the measured peak for the automatic deadline
+#define RENDER_TIME_SLACK_NS 1000000
 
-void OutputFrame(struct wl_listener* listener, void* data)
+//On the clock presentation timestamps use so the two can be compared
+static uint64_t NowNs()
 {
-	//This function is called every time an output is ready to display a frame, generally at the output's refresh rate (e.g. 60Hz).
-	class EshyWMOutput* output = wl_container_of(listener, output, FrameListener);
-	struct wlr_scene* scene = Server->Scene;
+	struct timespec now;
+	clock_gettime(wlr_backend_get_presentation_clock(Server->Backend), &now);
+	return now.tv_sec * 1000000000ull + now.tv_nsec;
+}
 
-	struct wlr_scene_output* scene_output = wlr_scene_get_scene_output(scene, output->WlrOutput);
+//As last reported by the backend, which knows better than the mode under adaptive sync. 0 when unknown
+static uint64_t GetRefreshNs(const EshyWMOutput* output)
+{
+	if (output->PresentRefreshNs > 0)
+		return output->PresentRefreshNs;
 
-	//Only runs when shared memory changes
-	SharedMemory = EshyIPC::AttachSharedMemoryBlock(EshybarShmID);
-	if(CurrentShm != std::string(SharedMemory.Block))
-	{
-		CurrentShm = std::string(SharedMemory.Block);
-		SharedMemoryUpdated(CurrentShm);
-	}
+	return output->WlrOutput->refresh > 0 ? 1000000000000ull / output->WlrOutput->refresh : 0;
+}
+
+static void RenderOutput(EshyWMOutput* output)
+{
+	const uint64_t Start = NowNs();
+	struct wlr_scene_output* scene_output = wlr_scene_get_scene_output(Server->Scene, output->WlrOutput);
+	output->bRenderScheduled = false;
+
+	//Send the title/app id changes that piled up since the last frame
+	Server->FlushMetadataUpdates();
+
+	//Move or resize the grabbed window once for all the motion since the last frame, right before it is drawn
+	Server->FlushGrabMotion();
+
+	//The commit clears the damage, count it first
+	uint64_t DamagedPixels = 0;
+	int RectCount = 0;
+	const pixman_box32_t* Rects = pixman_region32_rectangles(&scene_output->damage_ring.current, &RectCount);
+	for (int i = 0; i < RectCount; ++i)
+		DamagedPixels += (uint64_t)(Rects[i].x2 - Rects[i].x1) * (Rects[i].y2 - Rects[i].y1);
 
 	//Render the scene if needed and commit the output
+	const uint64_t CommitStart = NowNs();
+	output->FrameToCommitNs.Record(CommitStart - output->FrameVblankNs);
 	wlr_scene_output_commit(scene_output, nullptr);
+	output->CommitNs.Record(NowNs() - CommitStart);
+
+	//Nothing is committed when nothing was damaged, and no frame event follows until something is
+	output->bFrameCommitted = output->WlrOutput->frame_pending;
+	output->bCommitContinuous = output->bFrameCommitted && output->bFrameContinuous;
+	if (output->bFrameCommitted)
+		output->DamagedPixels.Record(DamagedPixels);
+
+	//The scene tries scanning out on every frame and remembers whether it did
+	output->bDirectScanout = scene_output->prev_scanout;
+	if (output->bDirectScanout)
+		output->DirectScanoutFrames++;
+	else
+		output->CompositedFrames++;
+
+	//Only a CPU side measure, the commit returns once the GPU work is submitted
+	output->RenderTimeNs = NowNs() - Start;
+	output->PeakRenderTimeNs = std::max(output->RenderTimeNs, output->PeakRenderTimeNs - output->PeakRenderTimeNs / 16);
+
+	const int Budget = output->GetRenderBudget();
+	if (Budget > 0 && output->RenderTimeNs > Budget * 1000000ull)
+		output->LateFrames++;
 
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
 	wlr_scene_output_send_frame_done(scene_output, &now);
 }
 
+void OutputFrame(struct wl_listener* listener, void* data)
+{
+	/*This function is called every time an output is ready to display a frame, generally at the output's refresh rate (e.g. 60Hz). It
+	*  fires right after vblank, so rendering straight away leaves the frame waiting for most of a refresh before it is shown. With a
+	*  render budget the frame is rendered that long before the next vblank instead.*/
+	class EshyWMOutput* output = wl_container_of(listener, output, FrameListener);
+
+	/*Damage while waiting schedules another frame event, which must not push the deadline back or a client committing faster than
+	*  the refresh rate would keep the output from ever rendering*/
+	if (output->bRenderScheduled)
+		return;
+
+	//A frame event that follows a commit comes from the vblank that presented it, otherwise the output was idle until now
+	const uint64_t Now = NowNs();
+	const uint64_t RefreshNs = GetRefreshNs(output);
+	output->bFrameContinuous = output->bFrameCommitted;
+	output->FrameVblankNs = output->bFrameContinuous && output->LastPresentNs <= Now && Now - output->LastPresentNs < RefreshNs ? output->LastPresentNs : Now;
+
+	//The display keeps its vblank phase while idle, so the next one is a whole number of refreshes after the last present
+	uint64_t NextVblankNs = 0;
+	if (RefreshNs > 0 && output->LastPresentNs && output->LastPresentNs <= Now)
+		NextVblankNs = output->LastPresentNs + ((Now - output->LastPresentNs) / RefreshNs + 1) * RefreshNs;
+
+	const int Budget = output->GetRenderBudget();
+	const int64_t Delay = ((int64_t)NextVblankNs - (int64_t)Now - Budget * 1000000ll) / 1000000;
+
+	//The timer has millisecond precision, not worth arming for less. Without a present to go by the vblank is unknown
+	if (Budget > 0 && NextVblankNs > 0 && Delay >= 1 && output->RenderTimer)
+	{
+		output->bRenderScheduled = true;
+		wl_event_source_timer_update(output->RenderTimer, (int)Delay);
+	}
+	else
+		RenderOutput(output);
+}
+
+void OutputPresent(struct wl_listener* listener, void* data)
+{
+	//The scene sends the presentation feedback to clients itself, this only keeps our timings on the real scanout times
+	class EshyWMOutput* output = wl_container_of(listener, output, PresentListener);
+	const struct wlr_output_event_present* event = (wlr_output_event_present*)data;
+	if (!event->presented || !event->when)
+		return;
+
+	if (event->refresh > 0)
+		output->PresentRefreshNs = event->refresh;
+
+	//Only a commit made for the frame event after the last present was due one refresh after it, otherwise the output was idle
+	const uint64_t When = event->when->tv_sec * 1000000000ull + event->when->tv_nsec;
+	if (output->bCommitContinuous && output->LastPresentNs && When > output->LastPresentNs)
+	{
+		const uint64_t Interval = When - output->LastPresentNs;
+		output->FrameIntervalNs.Record(Interval);
+
+		//The vblank counter when the backend has one, the refresh period otherwise
+		const uint64_t RefreshNs = GetRefreshNs(output);
+		uint64_t Vblanks = 1;
+		if (event->seq > output->LastPresentSeq && output->LastPresentSeq)
+			Vblanks = event->seq - output->LastPresentSeq;
+		else if (RefreshNs > 0)
+			Vblanks = (Interval + RefreshNs / 2) / RefreshNs;
+
+		const uint64_t Missed = Vblanks > 1 ? Vblanks - 1 : 0;
+		output->MissedVblanks.Record(Missed);
+		output->MissedVblankTotal += Missed;
+	}
+
+	output->LastPresentNs = When;
+	output->LastPresentSeq = event->seq;
+}
+
+int OutputRenderTimer(void* data)
+{
+	RenderOutput((EshyWMOutput*)data);
+	return 0;
+}
+
 void OutputRequestState(struct wl_listener* listener, void* data)
 {
 	/*This function is called when the backend requests a new state for
@@ -61,6 +187,28 @@ void OutputDestroy(struct wl_listener* listener, void* data)
 
 	wl_list_remove(&output->FrameListener.link);
 	wl_list_remove(&output->RequestStateListener.link);
+	wl_list_remove(&output->PresentListener.link);
 	wl_list_remove(&output->DestroyListener.link);
-	free(output);
+	Server->RemoveOutput(output);
+}
+
+int EshyWMOutput::GetRenderBudget() const
+{
+	if (MaxRenderTime != ESHYWM_MAX_RENDER_TIME_AUTO)
+		return MaxRenderTime;
+
+	//Nothing measured yet, render straight away
+	if (PeakRenderTimeNs == 0)
+		return 0;
+
+	return (int)((PeakRenderTimeNs + RENDER_TIME_SLACK_NS + 999999) / 1000000);
+}
+
+EshyWMOutput::~EshyWMOutput()
+{
+	if (RenderTimer)
+		wl_event_source_remove(RenderTimer);
+
+	for (EshyWMWorkspace* Workspace : Workspaces)
+		delete Workspace;
 }
\ No newline at end of file
@@ -6,13 +6,26 @@
 #include "Keyboard.h"
 #include "Output.h"
 #include "Config.h"
+#include "IPCServer.h"
+#include "Switcher.h"
+#include "HitTest.h"
+#include "Decoration.h"
+#include "TileLayout.h"
+#include "Workspace.h"
 #include "Util.h"
 
 #include "EshyIPC.h"
 
-#include <nlohmann/json.hpp>
-
 #include <linux/input-event-codes.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <cstdlib>
 
 #define static
 #define class wlr
@@ -30,6 +43,7 @@ extern "C"
 #include <wlr/types/wlr_output.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_presentation_time.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_subcompositor.h>
@@ -72,41 +86,95 @@ static void ServerCursorFrame(struct wl_listener* listener, void* data);
 
 static void ServerOutputChange(struct wl_listener* listener, void* data);
 static void ServerNewXdgSurface(struct wl_listener* listener, void* data);
+static void PopupDestroy(struct wl_listener* listener, void* data);
 static void NewXWaylandSurface(struct wl_listener* listener, void* data);
 
 static void SeatRequestCursor(struct wl_listener* listener, void* data);
 static void SeatRequestSetSelection(struct wl_listener* listener, void* data);
 
-void SharedMemoryUpdated(const std::string& CurrentShm)
+static int EshybarMessagesReady(int fd, uint32_t mask, void* data);
+static int DumpFrameStatsSignal(int signal_number, void* data);
+static int MetadataTimerFired(void* data);
+
+//Only tracks that a popup is alive, the hit tester leaves them to the scene graph
+struct EshyWMPopup
+{
+	struct wl_listener DestroyListener;
+};
+
+void SharedMemoryUpdated(const EshyWMMessage& Message)
 {
-	nlohmann::json Data = nlohmann::json::parse(CurrentShm);
-	if (Data["sender_client"] == CLIENT_ESHYBAR)
+	if (Message.SenderClient != CLIENT_ESHYBAR)
+		return;
+
+	//Eshybar may still be acting on a window that was closed in the meantime
+	EshyWMWindowBase* pointer = Server->Windows.Get(Message.WindowID);
+	if (!pointer)
+		return;
+
+	switch (Message.Action)
 	{
-		if (Data["action"] == ACTION_FOCUS_WINDOW)
-		{
-			if(EshyWMWindow* pointer = (EshyWMWindow*)((uint64_t)Data["window_id"]))
-				pointer->FocusWindow();
-		}
-		else if (Data["action"] == ACTION_UNFOCUS_WINDOW)
-		{
-			if(EshyWMWindow* pointer = (EshyWMWindow*)((uint64_t)Data["window_id"]))
-				pointer->FocusWindow();
-		}
-		else if (Data["action"] == ACTION_MINIMIZE_WINDOW)
-		{
-			if(EshyWMWindow* pointer = (EshyWMWindow*)((uint64_t)Data["window_id"]))
-				pointer->MinimizeWindow(true);
-		}
+	case ACTION_FOCUS_WINDOW:
+	case ACTION_UNFOCUS_WINDOW:
+		pointer->FocusWindow();
+		break;
+	case ACTION_MINIMIZE_WINDOW:
+		pointer->MinimizeWindow(true);
+		break;
+	default:
+		break;
 	}
 }
 
+int EshybarMessagesReady(int fd, uint32_t mask, void* data)
+{
+	EshyIPC::ClearNotifier(fd);
+
+	//Handle every message Eshybar sent since we were last woken, in order
+	EshyWMMessage Message;
+	if(EshybarReceiveChannel.HasNewMessages())
+		while(EshybarReceiveChannel.Receive(Message))
+			SharedMemoryUpdated(Message);
+
+	//Also fires when Eshybar made room in a full ring, so this is where anything that did not fit is retried
+	EshybarSendChannel.Flush();
+	return 0;
+}
+
+int MetadataTimerFired(void* data)
+{
+	Server->FlushMetadataUpdates();
+	return 0;
+}
+
+int DumpFrameStatsSignal(int signal_number, void* data)
+{
+	EshyWMIPCServer::DumpFrameStats();
+	return 0;
+}
+
 EshyWMServer::EshyWMServer()
-	: bWindowModifierKeyPressed(false)
-	, NextWindowIndex(0)
+	: WindowList(Windows.Values())
+	, bWindowModifierKeyPressed(false)
+	, Switcher(nullptr)
+	, HitTester(nullptr)
 	, CursorMode(ESHYWM_CURSOR_PASSTHROUGH)
 	, FocusedWindow(nullptr)
 	, Eshybar(nullptr)
+	, IPCServer(nullptr)
+	, MetadataTimer(nullptr)
+	, MetadataUpdatesEmitted(0)
+	, MetadataUpdatesCoalesced(0)
+	, bGrabMotionPending(false)
+	, GrabMotionTime(0)
+	, GrabMotionEvents(0)
+	, GrabMotionApplied(0)
+	, ResizeConfiguresSent(0)
+	, ResizeConfiguresCommitted(0)
 {
+	wl_list_init(&FocusOrder);
+	wl_list_init(&StackingOrder);
+
 	WlDisplay = wl_display_create();
 	Backend = wlr_backend_autocreate(WlDisplay, NULL);
     check(Backend, "Failed to create wlr_backend");
@@ -134,9 +202,16 @@ EshyWMServer::EshyWMServer()
 	Scene = wlr_scene_create();
 	SceneLayout = wlr_scene_attach_output_layout(Scene, OutputLayout);
 
+	//wp_presentation, the scene sends each surface's feedback with the real scanout time
+	Presentation = wlr_presentation_create(WlDisplay, Backend);
+	wlr_scene_set_presentation(Scene, Presentation);
+
 	for(int i = 0; i < L_NUM_LAYERS; i++)
 		Layers[i] = wlr_scene_tree_create(&Scene->tree);
 
+	Switcher = new EshyWMSwitcher(Layers[L_Overlay]);
+	HitTester = new EshyWMHitTester();
+
 	XdgShell = wlr_xdg_shell_create(WlDisplay, 3);
 	add_listener(&NewXdgSurfaceListener, ServerNewXdgSurface, &XdgShell->events.new_surface);
 
@@ -153,6 +228,14 @@ EshyWMServer::EshyWMServer()
 	Seat = wlr_seat_create(WlDisplay, "seat0");
 	add_listener(&request_cursor, SeatRequestCursor, &Seat->events.request_set_cursor);
 	add_listener(&request_set_selection, SeatRequestSetSelection, &Seat->events.request_set_selection);
+
+	//Wake up as soon as Eshybar sends something instead of waiting for the next frame
+	EshybarMessageSource = wl_event_loop_add_fd(wl_display_get_event_loop(WlDisplay), EshyIPC::GetNotifier(EshybarShmID, EIPC_TO_COMPOSITOR), WL_EVENT_READABLE, EshybarMessagesReady, nullptr);
+
+	MetadataTimer = wl_event_loop_add_timer(wl_display_get_event_loop(WlDisplay), MetadataTimerFired, nullptr);
+
+	//kill -USR1 logs the per-output frame histograms
+	FrameStatsSignalSource = wl_event_loop_add_signal(wl_display_get_event_loop(WlDisplay), SIGUSR1, DumpFrameStatsSignal, nullptr);
 }
 
 void EshyWMServer::BeginEventLoop()
@@ -174,27 +257,92 @@ void EshyWMServer::BeginEventLoop()
 
 	setenv("WAYLAND_DISPLAY", socket, true);
 
-	// if(fork() == 0)
-	// {
-	// 	int width;
-	// 	int height;
-	// 	wlr_output_effective_resolution(Server->OutputList[0]->WlrOutput, &width, &height);
+	//Control socket for scripts, next to the Wayland socket so each session gets its own
+	const char* RuntimeDir = getenv("XDG_RUNTIME_DIR");
+	const std::string IPCSocketPath = std::string(RuntimeDir ? RuntimeDir : "/tmp") + "/eshywm." + socket + ".sock";
+	IPCServer = new EshyWMIPCServer(wl_display_get_event_loop(WlDisplay));
+	if (IPCServer->Start(IPCSocketPath))
+		setenv("ESHYWM_SOCK", IPCSocketPath.c_str(), true);
 
-	// 	execl("eshybar", "eshybar", std::to_string(EshybarShmID).c_str(), std::to_string(width).c_str(), std::to_string(height).c_str(), (void*)NULL);
-	// }
+	//Helpers started below inherit the window snapshot and event broadcast and can map them from these tokens
+	setenv("ESHYWM_WINDOW_SNAPSHOT", EshyIPC::GetSharedMemoryToken(WindowSnapshotShmID).c_str(), true);
+	setenv("ESHYWM_EVENTS", EshyIPC::GetSharedMemoryToken(EventBroadcastShmID).c_str(), true);
+
+	//Eshybar inherits the notifiers so both sides can sleep until there is something to read, and the block itself when it is a memfd
+	if(!Server->OutputList.empty() && fork() == 0)
+	{
+		//SIGUSR1 is blocked for the event loop's signalfd, and exec keeps the mask
+		sigset_t Mask;
+		sigemptyset(&Mask);
+		sigprocmask(SIG_SETMASK, &Mask, nullptr);
+
+		int width;
+		int height;
+		wlr_output_effective_resolution(Server->GetPrimaryOutput()->WlrOutput, &width, &height);
+
+		const std::string ClientNotifier = std::to_string(EshyIPC::GetNotifier(EshybarShmID, EIPC_TO_CLIENT));
+		const std::string CompositorNotifier = std::to_string(EshyIPC::GetNotifier(EshybarShmID, EIPC_TO_COMPOSITOR));
+		execlp("eshybar", "eshybar", EshyIPC::GetSharedMemoryToken(EshybarShmID).c_str(), std::to_string(width).c_str(), std::to_string(height).c_str(), ClientNotifier.c_str(), CompositorNotifier.c_str(),
+			EshyIPC::GetSharedMemoryToken(WindowSnapshotShmID).c_str(), EshyIPC::GetSharedMemoryToken(EventBroadcastShmID).c_str(), (void*)NULL);
+		_exit(1);
+	}
 
 	//Excute startup commands
 	for(const std::string& command : EshyWMConfig::GetStartupCommands())
-        system(command.c_str());
+        RunCommand(command);
 
 	wl_display_run(WlDisplay);
 }
 
+void EshyWMServer::RunCommand(const std::string& Command)
+{
+	/*Unblocking around system() would leave a window where SIGUSR1 takes its default action and kills the compositor, so the shell is
+	*  spawned with an empty mask instead and only it and its children see the signal unblocked*/
+	sigset_t Mask;
+	sigemptyset(&Mask);
+
+	posix_spawnattr_t Attributes;
+	posix_spawnattr_init(&Attributes);
+	posix_spawnattr_setsigmask(&Attributes, &Mask);
+	posix_spawnattr_setflags(&Attributes, POSIX_SPAWN_SETSIGMASK);
+
+	pid_t Pid;
+	const char* Argv[] = {"sh", "-c", Command.c_str(), nullptr};
+	const int Error = posix_spawn(&Pid, "/bin/sh", nullptr, &Attributes, (char* const*)Argv, environ);
+	posix_spawnattr_destroy(&Attributes);
+
+	if (Error != 0)
+	{
+		wlr_log(WLR_ERROR, "Failed to run %s: %s", Command.c_str(), strerror(Error));
+		return;
+	}
+
+	int Status;
+	while (waitpid(Pid, &Status, 0) < 0 && errno == EINTR);
+}
+
 void EshyWMServer::Shutdown()
 {
+	wl_event_source_remove(EshybarMessageSource);
+	wl_event_source_remove(FrameStatsSignalSource);
+	wl_event_source_remove(MetadataTimer);
+	delete IPCServer;
 	wlr_xwayland_destroy(XWayland);
     wl_display_destroy_clients(WlDisplay);
+	delete Switcher;
+	delete HitTester;
+
+	//Outputs are only destroyed with the display below, their workspaces' trees go with the scene
+	for (EshyWMOutput* Output : OutputList)
+	{
+		for (EshyWMWorkspace* Workspace : Output->Workspaces)
+			delete Workspace;
+		Output->Workspaces.clear();
+		Output->ActiveWorkspace = nullptr;
+	}
+
 	wlr_scene_node_destroy(&Scene->tree.node);
+	EshyWMDecoration::DestroySharedBuffers();
 	wlr_xcursor_manager_destroy(CursorMgr);
 	wlr_output_layout_destroy(OutputLayout);
 	wl_display_destroy(WlDisplay);
@@ -208,9 +356,386 @@ void EshyWMServer::CloseWindow(EshyWMWindowBase* window)
 }
 
 
+void EshyWMServer::AddWindow(EshyWMWindowBase* Window)
+{
+	Window->Handle = Windows.Insert(Window);
+	wl_list_insert(FocusOrder.prev, &Window->FocusLink);
+}
+
+void EshyWMServer::RemoveWindow(EshyWMWindowBase* Window)
+{
+	HitTester->RemoveWindow(Window);
+	UntileWindow(Window);
+
+	wl_list_remove(&Window->FocusLink);
+	wl_list_remove(&Window->StackLink);
+
+	//Rebuilds from the lists, which no longer hold the window
+	Switcher->WindowRemoved(Window);
+
+	//Frees the window, its handle is rejected from here on
+	Windows.Remove(Window->Handle);
+}
+
+void EshyWMServer::RaiseWindow(EshyWMWindowBase* Window)
+{
+	wlr_scene_node_raise_to_top(&Window->Scene->node);
+
+	wl_list_remove(&Window->StackLink);
+	wl_list_insert(&StackingOrder, &Window->StackLink);
+
+	HitTester->WindowRaised(Window);
+}
+
+void EshyWMServer::TileWindow(EshyWMWindowBase* Window)
+{
+	if (Window->TileNode || !Window->Workspace)
+		return;
+
+	EshyWMTileNode* Target = FocusedWindow && FocusedWindow != Window && FocusedWindow->Workspace == Window->Workspace ? FocusedWindow->TileNode : nullptr;
+	Window->TileNode = Window->Workspace->TileLayout->Insert(Window, Target);
+}
+
+void EshyWMServer::UntileWindow(EshyWMWindowBase* Window)
+{
+	if (!Window->TileNode)
+		return;
+
+	Window->Workspace->TileLayout->Remove(Window->TileNode);
+	Window->TileNode = nullptr;
+}
+
+void EshyWMServer::FocusMostRecent(EshyWMWorkspace* Workspace)
+{
+	for (struct wl_list* Link = FocusOrder.next; Link != &FocusOrder; Link = Link->next)
+	{
+		EshyWMWindowBase* Window = wl_container_of(Link, Window, FocusLink);
+		struct wlr_surface* Surface = Window->GetSurface();
+		if (Window->Workspace == Workspace && Window->Scene && Window->Scene->node.enabled && Surface && Surface->mapped)
+		{
+			Window->FocusWindow();
+			return;
+		}
+	}
+
+	ClearFocus();
+}
+
+void EshyWMServer::ClearFocus()
+{
+	EshyWMWindowBase* PreviousWindow = FocusedWindow;
+	if (!PreviousWindow)
+		return;
+
+	PreviousWindow->UnfocusWindow();
+	FocusedWindow = nullptr;
+	wlr_seat_keyboard_notify_clear_focus(Seat);
+
+	NotifyWindowEvent(PreviousWindow->MakeWindowMessage(ACTION_UNFOCUS_WINDOW));
+}
+
+EshyWMWorkspace* EshyWMServer::GetCurrentWorkspace()
+{
+	if (OutputList.empty())
+		return nullptr;
+
+	return GetCursorOutput()->ActiveWorkspace;
+}
+
+struct wlr_scene_tree* EshyWMServer::GetWindowLayer(EshyWMWorkspace* Workspace, bool bTiled)
+{
+	if (!Workspace)
+		return Layers[bTiled ? L_Tile : L_Float];
+
+	return bTiled ? Workspace->TileTree : Workspace->FloatTree;
+}
+
+struct wlr_scene_tree* EshyWMServer::GetFullscreenLayer(EshyWMWorkspace* Workspace)
+{
+	return Workspace ? Workspace->FullscreenTree : Layers[L_Fullscreen];
+}
+
+void EshyWMServer::ShowWorkspace(EshyWMWorkspace* Workspace)
+{
+	EshyWMWorkspace* Previous = Workspace->Output->ActiveWorkspace;
+	if (Previous == Workspace)
+		return;
+
+	Previous->SetActive(false);
+	Workspace->SetActive(true);
+	Workspace->Output->ActiveWorkspace = Workspace;
+
+	//The windows on both just appeared or disappeared under the pointer
+	for (EshyWMWindowBase* Window : WindowList)
+		if (Window->Workspace == Previous || Window->Workspace == Workspace)
+			HitTester->UpdateWindow(Window);
+}
+
+void EshyWMServer::SwitchWorkspace(EshyWMOutput* Output, int Index)
+{
+	if (Index < 0 || Index >= (int)Output->Workspaces.size() || Output->Workspaces[Index] == Output->ActiveWorkspace)
+		return;
+
+	//A grabbed window may be about to disappear
+	ResetCursorMode();
+
+	ShowWorkspace(Output->Workspaces[Index]);
+	FocusMostRecent(Output->ActiveWorkspace);
+}
+
+void EshyWMServer::MoveWindowToWorkspace(EshyWMWindowBase* Window, EshyWMWorkspace* Workspace)
+{
+	if (!Window->Scene || Window->Workspace == Workspace)
+		return;
+
+	EshyWMWorkspace* Previous = Window->Workspace;
+	//Minimized tiled windows are out of the layout but still in the tile tree, fullscreen ones keep their tile
+	const bool bTiled = Window->TileNode || Window->Scene->node.parent == GetWindowLayer(Previous, true);
+	const bool bMinimized = Window->WindowState == ESHYWM_WINDOW_STATE_MINIMIZED;
+	const bool bFullscreen = (bMinimized ? Window->PreMinimizeState : Window->WindowState) == ESHYWM_WINDOW_STATE_FULLSCREEN;
+
+	UntileWindow(Window);
+	wlr_scene_node_reparent(&Window->Scene->node, bFullscreen ? GetFullscreenLayer(Workspace) : GetWindowLayer(Workspace, bTiled));
+	Window->Workspace = Workspace;
+
+	if (bTiled && !bMinimized)
+		TileWindow(Window);
+	else if (Workspace && !bFullscreen)
+	{
+		//Floating windows sent to another output are brought onto it
+		const struct wlr_box& OutputBox = Workspace->Output->UsableArea;
+		if (!wlr_box_empty(&OutputBox) && !wlr_box_contains_point(&OutputBox, Window->Scene->node.x, Window->Scene->node.y))
+		{
+			Window->WindowGeometry.x = OutputBox.x + EshyWMConfig::ESHYWM_BORDER_WIDTH;
+			Window->WindowGeometry.y = OutputBox.y + EshyWMConfig::ESHYWM_BORDER_WIDTH;
+			Window->SetPosition(Window->WindowGeometry.x, Window->WindowGeometry.y);
+		}
+	}
+
+	HitTester->UpdateWindow(Window);
+
+	if (Window == FocusedWindow && Workspace && !Workspace->IsActive())
+	{
+		ResetCursorMode();
+		FocusMostRecent(Previous);
+	}
+}
+
+void EshyWMServer::RemoveOutput(EshyWMOutput* Output)
+{
+	OutputList.erase(std::find(OutputList.begin(), OutputList.end(), Output));
+
+	EshyWMWorkspace* Target = OutputList.empty() ? nullptr : OutputList[0]->ActiveWorkspace;
+	for (EshyWMWindowBase* Window : WindowList)
+	{
+		if (Window->Workspace && Window->Workspace->Output == Output)
+			MoveWindowToWorkspace(Window, Target);
+
+		if (Window->Output == Output)
+		{
+			Window->Output = nullptr;
+			Window->UpdateOutput();
+		}
+	}
+
+	delete Output;
+}
+
+EshyWMOutput* EshyWMServer::GetOutputAt(double lx, double ly)
+{
+	EshyWMOutput* Nearest = nullptr;
+	double NearestDistance = 0.0;
+
+	for (EshyWMOutput* Output : OutputList)
+	{
+		//Not in the layout yet
+		if (wlr_box_empty(&Output->LayoutBox))
+			continue;
+
+		if (wlr_box_contains_point(&Output->LayoutBox, lx, ly))
+			return Output;
+
+		double ClosestX;
+		double ClosestY;
+		wlr_box_closest_point(&Output->LayoutBox, lx, ly, &ClosestX, &ClosestY);
+		const double Distance = (ClosestX - lx) * (ClosestX - lx) + (ClosestY - ly) * (ClosestY - ly);
+		if (!Nearest || Distance < NearestDistance)
+		{
+			Nearest = Output;
+			NearestDistance = Distance;
+		}
+	}
+
+	return Nearest ? Nearest : GetPrimaryOutput();
+}
+
+EshyWMOutput* EshyWMServer::GetCursorOutput()
+{
+	return GetOutputAt(Cursor->x, Cursor->y);
+}
+
+EshyWMOutput* EshyWMServer::GetWindowOutput(EshyWMWindowBase* Window)
+{
+	//Windows that were never placed go where the user is looking
+	return Window->Output ? Window->Output : GetCursorOutput();
+}
+
+EshyWMOutput* EshyWMServer::GetPrimaryOutput()
+{
+	return OutputList.empty() ? nullptr : OutputList[0];
+}
+
+void EshyWMServer::UpdateOutputAreas()
+{
+	for (EshyWMOutput* Output : OutputList)
+	{
+		wlr_output_layout_get_box(OutputLayout, Output->WlrOutput, &Output->LayoutBox);
+
+		Output->UsableArea = Output->LayoutBox;
+		if (Output == GetPrimaryOutput())
+			Output->UsableArea.height = std::max(Output->UsableArea.height - ESHYBAR_HEIGHT, 0);
+
+		const struct wlr_box& Area = Output->UsableArea;
+		for (EshyWMWorkspace* Workspace : Output->Workspaces)
+			Workspace->TileLayout->SetArea({Area.x, Area.y, Area.width, Area.height});
+	}
+
+	//Outputs may have moved out from under windows
+	for (EshyWMWindowBase* Window : WindowList)
+		if (Window->Scene)
+			Window->UpdateOutput();
+}
+
+
+void EshyWMServer::NotifyWindowEvent(const EshyWMMessage& Message)
+{
+	//The snapshot is updated first so anyone woken by the message below already sees the change in it
+	if (Message.Action == ACTION_REMOVE_WINDOW)
+		WindowSnapshot.Remove(Message.WindowID);
+	else if (EshyWMWindowBase* Window = Windows.Get(Message.WindowID))
+	{
+		//Eshybar shows windows missing from the snapshot from the event below instead
+		if (!WindowSnapshot.Upsert(Window->MakeWindowRecord()))
+			wlr_log(WLR_ERROR, "Window snapshot could not grow past %u windows, window %llu is only sent as an event", WindowSnapshot.GetCapacity(), (unsigned long long)Message.WindowID);
+	}
+
+	//Published once however many bars and tools are following, each reads it with its own cursor
+	EventBroadcast.Send(Message);
+
+	if (IPCServer)
+		IPCServer->BroadcastWindowEvent(Message);
+}
+
+
+void EshyWMServer::QueueMetadataUpdate(EshyWMWindowBase* Window)
+{
+	//Last writer wins, the update reads the current title and app id when it is sent
+	if (Window->bMetadataDirty)
+	{
+		MetadataUpdatesCoalesced++;
+		return;
+	}
+
+	Window->bMetadataDirty = true;
+	MetadataDirtyWindows.push_back(Window);
+
+	//A title change alone damages nothing, make sure a frame comes to send it
+	for (EshyWMOutput* Output : OutputList)
+		wlr_output_schedule_frame(Output->WlrOutput);
+}
+
+void EshyWMServer::FlushMetadataUpdates()
+{
+	if (MetadataDirtyWindows.empty())
+		return;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	const uint64_t NowMs = now.tv_sec * 1000ull + now.tv_nsec / 1000000;
+
+	//Windows still inside their rate limit stay queued until the earliest of them is due
+	const uint64_t Interval = (uint64_t)EshyWMConfig::ESHYWM_METADATA_UPDATE_INTERVAL;
+	uint64_t NextDueMs = UINT64_MAX;
+	size_t Remaining = 0;
+	for (EshyWMWindowBase* Window : MetadataDirtyWindows)
+	{
+		if (NowMs - Window->LastMetadataUpdateTime < Interval)
+		{
+			NextDueMs = std::min(NextDueMs, Window->LastMetadataUpdateTime + Interval);
+			MetadataDirtyWindows[Remaining++] = Window;
+			continue;
+		}
+
+		Window->bMetadataDirty = false;
+		Window->LastMetadataUpdateTime = NowMs;
+		MetadataUpdatesEmitted++;
+		NotifyWindowEvent(Window->MakeWindowMessage(ACTION_UPDATE_WINDOW));
+	}
+
+	MetadataDirtyWindows.resize(Remaining);
+
+	//A timer instead of scheduling frames, which would keep every output rendering just to wait
+	if (Remaining > 0 && MetadataTimer)
+		wl_event_source_timer_update(MetadataTimer, (int)std::max<uint64_t>(NextDueMs - NowMs, 1));
+}
+
+void EshyWMServer::CancelMetadataUpdate(EshyWMWindowBase* Window)
+{
+	if (!Window->bMetadataDirty)
+		return;
+
+	Window->bMetadataDirty = false;
+	MetadataDirtyWindows.erase(std::find(MetadataDirtyWindows.begin(), MetadataDirtyWindows.end(), Window));
+}
+
+
+void EshyWMServer::QueueGrabMotion(uint32_t Time)
+{
+	GrabMotionEvents++;
+	GrabMotionTime = Time;
+
+	if (EshyWMConfig::ESHYWM_COALESCE_GRAB_MOTION)
+	{
+		if (bGrabMotionPending)
+			return;
+
+		//The cursor moving may damage nothing, make sure a frame comes to apply it
+		bGrabMotionPending = true;
+		for (EshyWMOutput* Output : OutputList)
+			wlr_output_schedule_frame(Output->WlrOutput);
+		return;
+	}
+
+	bGrabMotionPending = true;
+	FlushGrabMotion();
+}
+
+void EshyWMServer::FlushGrabMotion()
+{
+	if (!bGrabMotionPending)
+		return;
+
+	bGrabMotionPending = false;
+	GrabMotionApplied++;
+
+	//Tiled windows stay in their tile, resizing one drags the divider it shares with its sibling
+	if (FocusedWindow->TileNode)
+	{
+		if (CursorMode == ESHYWM_CURSOR_RESIZE)
+			FocusedWindow->Workspace->TileLayout->MoveDivider(FocusedWindow->TileNode, Cursor->x, Cursor->y);
+		return;
+	}
+
+	if (CursorMode == ESHYWM_CURSOR_MOVE)
+		FocusedWindow->ProcessCursorMove(GrabMotionTime);
+	else if (CursorMode == ESHYWM_CURSOR_RESIZE)
+		FocusedWindow->ProcessCursorResize(GrabMotionTime);
+}
+
 void EshyWMServer::ResetCursorMode()
 {
 	CursorMode = ESHYWM_CURSOR_PASSTHROUGH;
+	bGrabMotionPending = false;
 }
 
 
@@ -308,12 +833,106 @@ void ServerNewInput(struct wl_listener* listener, void* data)
 	wlr_seat_set_capabilities(Server->Seat, caps);
 }
 
+//The mode of the configured size with the refresh rate closest to the configured one, or the fastest when no refresh rate is configured
+static struct wlr_output_mode* FindConfiguredMode(struct wlr_output* wlr_output, const EshyWMMonitorInfo& Info)
+{
+	struct wlr_output_mode* Best = nullptr;
+	struct wlr_output_mode* mode;
+	wl_list_for_each(mode, &wlr_output->modes, link)
+	{
+		if (mode->width != Info.Width || mode->height != Info.Height)
+			continue;
+
+		//Configured in Hz, modes are in mHz
+		if (!Best
+			|| (Info.Refresh > 0 && std::abs(mode->refresh - Info.Refresh * 1000) < std::abs(Best->refresh - Info.Refresh * 1000))
+			|| (Info.Refresh <= 0 && mode->refresh > Best->refresh))
+			Best = mode;
+	}
+
+	return Best;
+}
+
+/*Enables the output with the configured mode, falling back to the preferred mode and then to every other mode it advertises. Each
+*  candidate is tested first so only a state the backend accepts gets committed. Scale and adaptive sync are part of the same state,
+*  if no mode works with adaptive sync the ladder is walked again without it.*/
+static void ConfigureOutput(struct wlr_output* wlr_output, const EshyWMMonitorInfo& Info)
+{
+	std::vector<struct wlr_output_mode*> Modes;
+	if (struct wlr_output_mode* mode = FindConfiguredMode(wlr_output, Info))
+		Modes.push_back(mode);
+
+	if (struct wlr_output_mode* mode = wlr_output_preferred_mode(wlr_output); mode && std::find(Modes.begin(), Modes.end(), mode) == Modes.end())
+		Modes.push_back(mode);
+
+	struct wlr_output_mode* mode;
+	wl_list_for_each(mode, &wlr_output->modes, link)
+		if (std::find(Modes.begin(), Modes.end(), mode) == Modes.end())
+			Modes.push_back(mode);
+
+	//The output may be disabled, switch it on
+	struct wlr_output_state state;
+	wlr_output_state_init(&state);
+	wlr_output_state_set_enabled(&state, true);
+
+	if (Info.Scale > 0)
+		wlr_output_state_set_scale(&state, Info.Scale);
+
+	bool bAccepted = false;
+	for (int Pass = 0; Pass < (Info.bAdaptiveSync ? 2 : 1) && !bAccepted; ++Pass)
+	{
+		if (Info.bAdaptiveSync)
+			wlr_output_state_set_adaptive_sync_enabled(&state, Pass == 0);
+
+		//Nested backends have no modes but take any size
+		if (Modes.empty())
+		{
+			if (Info.Width > 0 && Info.Height > 0)
+				wlr_output_state_set_custom_mode(&state, Info.Width, Info.Height, Info.Refresh * 1000);
+
+			bAccepted = wlr_output_test_state(wlr_output, &state);
+		}
+
+		for (struct wlr_output_mode* Candidate : Modes)
+		{
+			wlr_output_state_set_mode(&state, Candidate);
+			if (wlr_output_test_state(wlr_output, &state))
+			{
+				bAccepted = true;
+				if (Candidate != Modes[0] || (Info.Width > 0 && Candidate->width != Info.Width))
+					wlr_log(WLR_INFO, "Output %s falling back to %dx%d@%dmHz", wlr_output->name, Candidate->width, Candidate->height, Candidate->refresh);
+				break;
+			}
+		}
+	}
+
+	if (!bAccepted)
+	{
+		//The last candidate tried is arbitrary, commit what the output itself asks for instead
+		if (struct wlr_output_mode* Preferred = wlr_output_preferred_mode(wlr_output))
+			wlr_output_state_set_mode(&state, Preferred);
+		else if (!Modes.empty())
+			wlr_output_state_set_mode(&state, Modes[0]);
+
+		if (Info.bAdaptiveSync)
+			wlr_output_state_set_adaptive_sync_enabled(&state, false);
+
+		wlr_log(WLR_ERROR, "Output %s rejected every mode, committing anyway", wlr_output->name);
+	}
+	else if (Info.bAdaptiveSync && !state.adaptive_sync_enabled)
+		wlr_log(WLR_INFO, "Output %s does not support adaptive sync", wlr_output->name);
+
+	//Atomically applies the new output state
+	wlr_output_commit_state(wlr_output, &state);
+	wlr_output_state_finish(&state);
+}
+
 void ServerNewOutput(struct wl_listener* listener, void* data)
 {
 	struct wlr_output* wlr_output = (struct wlr_output*)data;
 
 	//If monitor exists in configuration then retrieve data
-	EshyWMMonitorInfo OutputInfo;
+	EshyWMMonitorInfo OutputInfo = {"", 0, 0, 0, 0, 0, 0, false};
 	for(const EshyWMMonitorInfo& Info : EshyWMConfig::GetMonitorInfoList())
 		if(Info.Name == std::string(wlr_output->name))
 		{
@@ -325,26 +944,24 @@ void ServerNewOutput(struct wl_listener* listener, void* data)
 	*  and our renderer. Must be done once, before commiting the output*/
 	wlr_output_init_render(wlr_output, Server->Allocator, Server->Renderer);
 
-	//The output may be disabled, switch it on
-	struct wlr_output_state state;
-	wlr_output_state_init(&state);
-	wlr_output_state_set_enabled(&state, true);
-
-	//Select monitor's preferred mode
-	if (struct wlr_output_mode* mode = wlr_output_preferred_mode(wlr_output))
-		wlr_output_state_set_mode(&state, mode);
-
-	//Atomically applies the new output state
-	wlr_output_commit_state(wlr_output, &state);
-	wlr_output_state_finish(&state);
+	ConfigureOutput(wlr_output, OutputInfo);
 
 	//Allocates and configures our state for this output
 	EshyWMOutput* output = new EshyWMOutput(wlr_output);
 	add_listener(&output->FrameListener, OutputFrame, &wlr_output->events.frame);
 	add_listener(&output->RequestStateListener, OutputRequestState, &wlr_output->events.request_state);
 	add_listener(&output->DestroyListener, OutputDestroy, &wlr_output->events.destroy);
+	add_listener(&output->PresentListener, OutputPresent, &wlr_output->events.present);
+	output->MaxRenderTime = OutputInfo.MaxRenderTime;
+	output->RenderTimer = wl_event_loop_add_timer(wl_display_get_event_loop(Server->WlDisplay), OutputRenderTimer, output);
 	Server->OutputList.push_back(output);
 
+	//Before the output joins the layout, which lays the workspaces out over it
+	for (int i = 0; i < ESHYWM_WORKSPACE_COUNT; ++i)
+		output->Workspaces.push_back(new EshyWMWorkspace(output, i));
+	output->ActiveWorkspace = output->Workspaces[0];
+	output->ActiveWorkspace->SetActive(true);
+
 	//Add the output to the output layout arranged as specified in configuration. If no specification exists, then arragement is left to right.
 	if(OutputInfo.Name != "")
 	{
@@ -354,29 +971,34 @@ void ServerNewOutput(struct wl_listener* listener, void* data)
 	}
 	else
 	{
+		//Scaled outputs take up less of the layout
 		int OffsetX = 0;
 		for(const EshyWMOutput* Output : Server->OutputList)
-			OffsetX += Output->WlrOutput->width;
-		OffsetX -= Server->OutputList[Server->OutputList.size() - 1]->WlrOutput->width;
+		{
+			int Width, Height;
+			wlr_output_effective_resolution(Output->WlrOutput, &Width, &Height);
+			if (Output != output)
+				OffsetX += Width;
+		}
 
 		struct wlr_output_layout_output* layout_output = wlr_output_layout_add(Server->OutputLayout, wlr_output, OffsetX, 0);
 		struct wlr_scene_output* scene_output = wlr_scene_output_create(Server->Scene, wlr_output);
 		wlr_scene_output_layout_add_output(Server->SceneLayout, layout_output, scene_output);
 	}
+
+	//Windows left without a workspace when the last output went away
+	for (EshyWMWindowBase* Window : Server->WindowList)
+		if (Window->Scene && !Window->Workspace && Window->WindowType != WT_X11Unmanaged)
+			Server->MoveWindowToWorkspace(Window, output->ActiveWorkspace);
 }
 
 
 static void ProcessCursorMotion(uint32_t time)
 {
 	//If the mode is non-passthrough, delegate to those functions
-	if (Server->CursorMode == ESHYWM_CURSOR_MOVE)
-	{
-		Server->FocusedWindow->ProcessCursorMove(time);
-		return;
-	}
-	else if (Server->CursorMode == ESHYWM_CURSOR_RESIZE)
+	if (Server->CursorMode != ESHYWM_CURSOR_PASSTHROUGH)
 	{
-		Server->FocusedWindow->ProcessCursorResize(time);
+		Server->QueueGrabMotion(time);
 		return;
 	}
 
@@ -384,7 +1006,7 @@ static void ProcessCursorMotion(uint32_t time)
 	double sx, sy;
 	struct wlr_seat* seat = Server->Seat;
 	struct wlr_surface* surface = NULL;
-	EshyWMWindowBase* window = DesktopWindowAt(Server->Cursor->x, Server->Cursor->y, &surface, &sx, &sy);
+	EshyWMWindowBase* window = Server->HitTester->WindowAt(Server->Cursor->x, Server->Cursor->y, &surface, &sx, &sy);
 
 	if (!window)
 		wlr_cursor_set_xcursor(Server->Cursor, Server->CursorMgr, "default");
@@ -420,19 +1042,25 @@ void ServerCursorButton(struct wl_listener* listener, void* data)
 	double sx;
 	double sy;
 	struct wlr_surface* surface = NULL;
-	EshyWMWindowBase* window = DesktopWindowAt(Server->Cursor->x, Server->Cursor->y, &surface, &sx, &sy);
+	EshyWMWindowBase* window = Server->HitTester->WindowAt(Server->Cursor->x, Server->Cursor->y, &surface, &sx, &sy);
 
 	if(window && window->WindowType == WT_XDGShell && ((EshyWMWindow*)window)->XdgToplevel->app_id == "eshybar")
 		return;
 
 	if (event->state == WLR_BUTTON_RELEASED)
+	{
+		//Land the grab where the cursor was let go
+		Server->FlushGrabMotion();
 		Server->ResetCursorMode();
+	}
 	else if (window)
 		window->FocusWindow();
 	else if (!window && Server->FocusedWindow)
 	{
-		Server->FocusedWindow->UnfocusWindow();
+		EshyWMWindowBase* PreviousWindow = Server->FocusedWindow;
+		PreviousWindow->UnfocusWindow();
 		Server->FocusedWindow = nullptr;
+		Server->NotifyWindowEvent(PreviousWindow->MakeWindowMessage(ACTION_UNFOCUS_WINDOW));
 	}
 
 	if(Server->bWindowModifierKeyPressed && event->state == WLR_BUTTON_PRESSED && window)
@@ -468,20 +1096,22 @@ void ServerOutputChange(struct wl_listener* listener, void* data)
 {
 	struct wlr_output_layout_output* event = (wlr_output_layout_output*)data;
 
-	if(!Server->Eshybar)
+	Server->UpdateOutputAreas();
+	Server->HitTester->RebuildOutputs();
+
+	EshyWMOutput* Primary = Server->GetPrimaryOutput();
+	if(!Server->Eshybar || !Primary)
 		return;
 
 	int Width;
 	int Height;
-	wlr_output_effective_resolution(Server->OutputList[0]->WlrOutput, &Width, &Height);
-	wlr_scene_node_set_position(&Server->Eshybar->SceneTree->node, 0, Height - 50);
+	wlr_output_effective_resolution(Primary->WlrOutput, &Width, &Height);
+	wlr_scene_node_set_position(&Server->Eshybar->SceneTree->node, Primary->LayoutBox.x, Primary->LayoutBox.y + Height - ESHYBAR_HEIGHT);
 
-	nlohmann::json ConfigureEshybarInfo;
-	ConfigureEshybarInfo["action"] = ACTION_CONFIGURE_ESHYBAR;
-	ConfigureEshybarInfo["sender_client"] = CLIENT_COMPOSITOR;
-	ConfigureEshybarInfo["width"] = Width;
-	ConfigureEshybarInfo["height"] = Height;
-	EshyIPC::InsertIntoMemory(EshybarShmID, ConfigureEshybarInfo.dump());
+	EshyWMMessage ConfigureEshybarInfo = MakeMessage(ACTION_CONFIGURE_ESHYBAR, CLIENT_COMPOSITOR);
+	ConfigureEshybarInfo.Width = Width;
+	ConfigureEshybarInfo.Height = Height;
+	EshybarSendChannel.Send(ConfigureEshybarInfo);
 }
 
 void ServerNewXdgSurface(struct wl_listener* listener, void* data)
@@ -495,12 +1125,26 @@ void ServerNewXdgSurface(struct wl_listener* listener, void* data)
 		struct wlr_scene_tree* parent_tree = (wlr_scene_tree*)parent->data;
 		xdg_surface->data = wlr_scene_xdg_surface_create(parent_tree, xdg_surface);
 
-		//Center the popup
-		struct wlr_box geo_box;
-		wlr_xdg_surface_get_geometry(parent, &geo_box);
-		const int XPosition = (Server->OutputList[0]->WlrOutput->width / 2) - (geo_box.width / 2);
-		const int YPosition = (Server->OutputList[0]->WlrOutput->height / 2) - (geo_box.height / 2);
-		wlr_scene_node_set_position(&parent_tree->node, XPosition, YPosition);
+		EshyWMPopup* Popup = new EshyWMPopup();
+		add_listener(&Popup->DestroyListener, PopupDestroy, &xdg_surface->events.destroy);
+		Server->HitTester->PopupCreated();
+
+		//Keep the popup on the output its toplevel is on, in the toplevel's surface coordinates
+		struct wlr_xdg_surface* Root = parent;
+		while (Root->role == WLR_XDG_SURFACE_ROLE_POPUP)
+			Root = wlr_xdg_surface_try_from_wlr_surface(Root->popup->parent);
+
+		int RootX;
+		int RootY;
+		struct wlr_scene_tree* RootTree = (wlr_scene_tree*)Root->data;
+		if (RootTree && wlr_scene_node_coords(&RootTree->node, &RootX, &RootY))
+			if (EshyWMOutput* Output = Server->GetOutputAt(RootX, RootY))
+			{
+				struct wlr_box Box = Output->LayoutBox;
+				Box.x -= RootX;
+				Box.y -= RootY;
+				wlr_xdg_popup_unconstrain_from_box(xdg_surface->popup, &Box);
+			}
 	}
 	else if (xdg_surface->toplevel->title && std::string(xdg_surface->toplevel->title) == std::string("Eshybar"))
 	{
@@ -509,58 +1153,38 @@ void ServerNewXdgSurface(struct wl_listener* listener, void* data)
 
 		Server->Eshybar = Eshybar;
 
-		int width;
-		int height;
-		wlr_output_effective_resolution(Server->OutputList[0]->WlrOutput, &width, &height);
-		wlr_scene_node_set_position(&Eshybar->SceneTree->node, 0, height - 50);
-
-		//Send a message for all windows that exist at the time the bar is created
-		for (EshyWMWindowBase* Window : Server->WindowList)
+		if (EshyWMOutput* Primary = Server->GetPrimaryOutput())
 		{
-#define class wlr
-			const std::string AppID = Window->WindowType == WT_XDGShell ? (((EshyWMWindow*)Window)->XdgToplevel->app_id ? ((EshyWMWindow*)Window)->XdgToplevel->app_id : "NO_APP_ID") : Window->WindowType == WT_X11Managed ? (((EshyWMXWindow*)Window)->XWaylandSurface->class ? ((EshyWMXWindow*)Window)->XWaylandSurface->class : "NO_APP_CLASS") : "NO_APP_CLASS";
-			const std::string Title = Window->WindowType == WT_XDGShell ? (((EshyWMWindow*)Window)->XdgToplevel->title ? ((EshyWMWindow*)Window)->XdgToplevel->title : "NO_TITLE") : Window->WindowType == WT_X11Managed ? (((EshyWMXWindow*)Window)->XWaylandSurface->title ? ((EshyWMXWindow*)Window)->XWaylandSurface->title : "NO_TITLE") : "NO_TITLE";
-#undef class
-			nlohmann::json WindowAddInfo;
-			WindowAddInfo["action"] = ACTION_ADD_WINDOW;
-			WindowAddInfo["sender_client"] = CLIENT_COMPOSITOR;
-			WindowAddInfo["window_id"] = (uint64_t)Window;
-			WindowAddInfo["app_id"] = AppID;
-			WindowAddInfo["title"] = Title;
-			EshyIPC::InsertIntoMemory(EshybarShmID, WindowAddInfo.dump());
+			int width;
+			int height;
+			wlr_output_effective_resolution(Primary->WlrOutput, &width, &height);
+			wlr_scene_node_set_position(&Eshybar->SceneTree->node, Primary->LayoutBox.x, Primary->LayoutBox.y + height - ESHYBAR_HEIGHT);
 		}
 	}
 	else
 	{
 		EshyWMWindow* Window = new EshyWMWindow(xdg_surface);
-		Server->WindowList.push_back(Window);
-
-		nlohmann::json WindowAddInfo;
-		WindowAddInfo["action"] = ACTION_ADD_WINDOW;
-		WindowAddInfo["sender_client"] = CLIENT_COMPOSITOR;
-		WindowAddInfo["window_id"] = (uint64_t)Window;
-		WindowAddInfo["app_id"] = Window->XdgToplevel->app_id ? Window->XdgToplevel->app_id : "NO_APP_ID";
-		WindowAddInfo["title"] = Window->XdgToplevel->title ? Window->XdgToplevel->title : "NO_TITLE";
-		EshyIPC::InsertIntoMemory(EshybarShmID, WindowAddInfo.dump());
+		Server->AddWindow(Window);
+		Server->NotifyWindowEvent(Window->MakeWindowMessage(ACTION_ADD_WINDOW));
 	}
 }
 
+void PopupDestroy(struct wl_listener* listener, void* data)
+{
+	EshyWMPopup* Popup = wl_container_of(listener, Popup, DestroyListener);
+	wl_list_remove(&Popup->DestroyListener.link);
+	delete Popup;
+
+	Server->HitTester->PopupDestroyed();
+}
+
 void NewXWaylandSurface(struct wl_listener* listener, void* data)
 {
 	struct wlr_xwayland_surface* XSurface = (wlr_xwayland_surface*)data;
 
 	EshyWMXWindow* Window = new EshyWMXWindow(XSurface);
-	Server->WindowList.push_back(Window);
-
-	nlohmann::json WindowAddInfo;
-	WindowAddInfo["action"] = ACTION_ADD_WINDOW;
-	WindowAddInfo["sender_client"] = CLIENT_COMPOSITOR;
-	WindowAddInfo["window_id"] = (uint64_t)Window;
-#define class wlr
-	WindowAddInfo["app_id"] = Window->XWaylandSurface->class ? Window->XWaylandSurface->class : "NO_APP_CLASS";
-#undef class
-	WindowAddInfo["title"] = Window->XWaylandSurface->title ? Window->XWaylandSurface->title : "NO_TITLE";
-	EshyIPC::InsertIntoMemory(EshybarShmID, WindowAddInfo.dump());
+	Server->AddWindow(Window);
+	Server->NotifyWindowEvent(Window->MakeWindowMessage(ACTION_ADD_WINDOW));
 }
 
 
@@ -14,7 +14,8 @@ extern "C"
 EshyWMSpecialWindow::EshyWMSpecialWindow(struct wlr_xdg_surface* xdg_surface)
 {
     XdgToplevel = xdg_surface->toplevel;
-    SceneTree = wlr_scene_xdg_surface_create(&Server->Scene->tree, XdgToplevel->base);
+    //Under fullscreen windows so they can be scanned out
+    SceneTree = wlr_scene_xdg_surface_create(Server->Layers[L_Top], XdgToplevel->base);
     SceneTree->node.data = this;
     xdg_surface->data = SceneTree;
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+#include "Switcher.h"
+#include "Server.h"
+#include "Window.h"
+#include "Config.h"
+#include "Output.h"
+#include "Workspace.h"
+
+#define static
+
+extern "C"
+{
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+}
+
+#undef static
+
+#include <algorithm>
+
+#define SWITCHER_TILE_WIDTH		160
+#define SWITCHER_TILE_HEIGHT	100
+#define SWITCHER_PADDING		10
+#define SWITCHER_HIGHLIGHT		4
+
+static const float SwitcherBackgroundColor[4] = {0.1f, 0.1f, 0.1f, 0.9f};
+static const float SwitcherTileColor[4] = {0.25f, 0.25f, 0.25f, 1.0f};
+
+EshyWMSwitcher::EshyWMSwitcher(struct wlr_scene_tree* _Parent)
+	: Parent(_Parent)
+	, Tree(nullptr)
+	, Highlight(nullptr)
+	, TileCount(0)
+	, Selected(nullptr)
+	, OriginalTopWindow(nullptr)
+	, SelectedPosition(0)
+{}
+
+//Mapped, managed windows on a workspace that is being shown
+static bool IsSwitchable(EshyWMWindowBase* Window)
+{
+	return Window->IsMapped() && Window->WindowType != WT_X11Unmanaged && Window->Workspace && Window->Workspace->IsActive();
+}
+
+void EshyWMSwitcher::Next()
+{
+	if (!IsActive() && !Open())
+		return;
+
+	Select(1);
+}
+
+void EshyWMSwitcher::Previous()
+{
+	if (!IsActive() && !Open())
+		return;
+
+	Select(-1);
+}
+
+void EshyWMSwitcher::Commit()
+{
+	if (!IsActive())
+		return;
+
+	EshyWMWindowBase* Window = Selected;
+	Close();
+
+	//It may have unmapped while the switcher was open
+	if (Window->IsMapped())
+		Window->FocusWindow();
+}
+
+void EshyWMSwitcher::Cancel()
+{
+	if (!IsActive())
+		return;
+
+	EshyWMWindowBase* Window = OriginalTopWindow;
+	Close();
+
+	if (Window && Window->IsMapped())
+		Server->RaiseWindow(Window);
+}
+
+void EshyWMSwitcher::WindowRemoved(EshyWMWindowBase* Window)
+{
+	if (!IsActive())
+		return;
+
+	if (Window == OriginalTopWindow)
+		OriginalTopWindow = nullptr;
+
+	if (std::find(Candidates.begin(), Candidates.end(), Window) == Candidates.end())
+		return;
+
+	//Tiles and positions would be stale, start over without it. Window is unmapped or out of FocusOrder so Open skips it
+	EshyWMWindowBase* const PreviousTopWindow = OriginalTopWindow;
+	Close();
+	if (Open())
+	{
+		OriginalTopWindow = PreviousTopWindow;
+		Select(1);
+	}
+}
+
+bool EshyWMSwitcher::Open()
+{
+	Candidates.clear();
+	for (struct wl_list* Link = Server->FocusOrder.next; Link != &Server->FocusOrder; Link = Link->next)
+	{
+		EshyWMWindowBase* Window = wl_container_of(Link, Window, FocusLink);
+		if (IsSwitchable(Window))
+			Candidates.push_back(Window);
+	}
+
+	if (Candidates.empty())
+		return false;
+
+	OriginalTopWindow = nullptr;
+	if (!wl_list_empty(&Server->StackingOrder))
+		OriginalTopWindow = wl_container_of(Server->StackingOrder.next, OriginalTopWindow, StackLink);
+
+	Selected = Candidates[0];
+	SelectedPosition = 0;
+	BuildOverlay();
+	return true;
+}
+
+void EshyWMSwitcher::Close()
+{
+	if (Tree)
+		wlr_scene_node_destroy(&Tree->node);
+
+	Tree = nullptr;
+	Highlight = nullptr;
+	TileCount = 0;
+	Selected = nullptr;
+	OriginalTopWindow = nullptr;
+	Candidates.clear();
+}
+
+void EshyWMSwitcher::BuildOverlay()
+{
+	//Center on the output the cursor is on
+	struct wlr_box OutputBox = {0, 0, 0, 0};
+	if (EshyWMOutput* Output = Server->GetCursorOutput())
+		OutputBox = Output->LayoutBox;
+
+	const int MaxTiles = std::max(1, (OutputBox.width - SWITCHER_PADDING) / (SWITCHER_TILE_WIDTH + SWITCHER_PADDING));
+	TileCount = std::min((int)Candidates.size(), MaxTiles);
+
+	const int Width = TileCount * (SWITCHER_TILE_WIDTH + SWITCHER_PADDING) + SWITCHER_PADDING;
+	const int Height = SWITCHER_TILE_HEIGHT + 2 * SWITCHER_PADDING;
+
+	Tree = wlr_scene_tree_create(Parent);
+	wlr_scene_node_set_position(&Tree->node, OutputBox.x + (OutputBox.width - Width) / 2, OutputBox.y + (OutputBox.height - Height) / 2);
+	wlr_scene_rect_create(Tree, Width, Height, SwitcherBackgroundColor);
+
+	Highlight = wlr_scene_rect_create(Tree, SWITCHER_TILE_WIDTH + 2 * SWITCHER_HIGHLIGHT, SWITCHER_TILE_HEIGHT + 2 * SWITCHER_HIGHLIGHT, EshyWMConfig::ESHYWM_COLOR_BORDER_FOCUSED);
+
+	//One tile per window in focus order, with the window's shape drawn to scale inside it
+	for (int i = 0; i < TileCount; ++i)
+	{
+		EshyWMWindowBase* Window = Candidates[i];
+		const int TileX = SWITCHER_PADDING + i * (SWITCHER_TILE_WIDTH + SWITCHER_PADDING);
+
+		struct wlr_scene_rect* Tile = wlr_scene_rect_create(Tree, SWITCHER_TILE_WIDTH, SWITCHER_TILE_HEIGHT, SwitcherBackgroundColor);
+		wlr_scene_node_set_position(&Tile->node, TileX, SWITCHER_PADDING);
+
+		const double Scale = Window->WindowGeometry.width > 0 && Window->WindowGeometry.height > 0
+			? std::min((double)(SWITCHER_TILE_WIDTH - 2 * SWITCHER_PADDING) / Window->WindowGeometry.width, (double)(SWITCHER_TILE_HEIGHT - 2 * SWITCHER_PADDING) / Window->WindowGeometry.height)
+			: 0.0;
+		const int ShapeWidth = Scale > 0.0 ? std::max(1, (int)(Window->WindowGeometry.width * Scale)) : SWITCHER_TILE_WIDTH - 2 * SWITCHER_PADDING;
+		const int ShapeHeight = Scale > 0.0 ? std::max(1, (int)(Window->WindowGeometry.height * Scale)) : SWITCHER_TILE_HEIGHT - 2 * SWITCHER_PADDING;
+
+		struct wlr_scene_rect* Shape = wlr_scene_rect_create(Tree, ShapeWidth, ShapeHeight, Window->WindowState == ESHYWM_WINDOW_STATE_MINIMIZED ? SwitcherBackgroundColor : SwitcherTileColor);
+		wlr_scene_node_set_position(&Shape->node, TileX + (SWITCHER_TILE_WIDTH - ShapeWidth) / 2, SWITCHER_PADDING + (SWITCHER_TILE_HEIGHT - ShapeHeight) / 2);
+	}
+}
+
+void EshyWMSwitcher::Select(int Step)
+{
+	const size_t WindowCount = Candidates.size();
+	SelectedPosition = (SelectedPosition + WindowCount + Step) % WindowCount;
+	Selected = Candidates[SelectedPosition];
+
+	//Windows past the last tile are still selectable, they just have no tile to highlight
+	const bool bOnScreen = SelectedPosition < (size_t)TileCount;
+	wlr_scene_node_set_enabled(&Highlight->node, bOnScreen);
+	if (bOnScreen)
+		wlr_scene_node_set_position(&Highlight->node, SWITCHER_PADDING + SelectedPosition * (SWITCHER_TILE_WIDTH + SWITCHER_PADDING) - SWITCHER_HIGHLIGHT, SWITCHER_PADDING - SWITCHER_HIGHLIGHT);
+
+	//Preview by bringing the candidate to the top without focusing it
+	if (Selected->IsMapped())
+		Server->RaiseWindow(Selected);
+}
@@ -0,0 +1,168 @@
+#include "TileLayout.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define TILE_MIN_RATIO 0.05f
+#define TILE_MAX_RATIO 0.95f
+
+EshyWMTileLayout::EshyWMTileLayout(PlaceFunction _Place)
+	: Place(_Place)
+	, Root(nullptr)
+	, LastLeaf(nullptr)
+	, LeafCount(0)
+	, Area({0, 0, 0, 0})
+	, NodesLaidOut(0)
+{}
+
+EshyWMTileLayout::~EshyWMTileLayout()
+{
+	DestroyTree(Root);
+}
+
+void EshyWMTileLayout::SetArea(const EshyWMTileRect& _Area)
+{
+	Area = _Area;
+
+	if (Root)
+		Layout(Root, Area, false);
+}
+
+EshyWMTileNode* EshyWMTileLayout::Insert(void* Client, EshyWMTileNode* Target)
+{
+	EshyWMTileNode* Leaf = new EshyWMTileNode{nullptr, {nullptr, nullptr}, TS_Horizontal, 0.5f, {0, 0, 0, 0}, Client};
+	LeafCount++;
+
+	if (!Root)
+	{
+		Root = LastLeaf = Leaf;
+		Layout(Leaf, Area, false);
+		return Leaf;
+	}
+
+	if (!Target)
+		Target = LastLeaf;
+
+	//The new split takes over Target's place and tile, Target keeps the first half
+	EshyWMTileNode* Split = new EshyWMTileNode{Target->Parent, {Target, Leaf}, TS_Horizontal, 0.5f, {0, 0, 0, 0}, nullptr};
+	Split->Split = Target->Rect.Width >= Target->Rect.Height ? TS_Horizontal : TS_Vertical;
+	Replace(Target, Split);
+	Target->Parent = Split;
+	Leaf->Parent = Split;
+
+	Layout(Split, Target->Rect, true);
+
+	LastLeaf = Leaf;
+	return Leaf;
+}
+
+void EshyWMTileLayout::Remove(EshyWMTileNode* Leaf)
+{
+	LeafCount--;
+
+	if (Leaf == Root)
+	{
+		delete Leaf;
+		Root = LastLeaf = nullptr;
+		return;
+	}
+
+	//The sibling grows into the parent split's tile
+	EshyWMTileNode* Split = Leaf->Parent;
+	EshyWMTileNode* Sibling = Split->Children[0] == Leaf ? Split->Children[1] : Split->Children[0];
+	Replace(Split, Sibling);
+	Sibling->Parent = Split->Parent;
+
+	if (LastLeaf == Leaf)
+	{
+		LastLeaf = Sibling;
+		while (!LastLeaf->IsLeaf())
+			LastLeaf = LastLeaf->Children[1];
+	}
+
+	Layout(Sibling, Split->Rect, false);
+
+	delete Leaf;
+	delete Split;
+}
+
+void EshyWMTileLayout::MoveDivider(EshyWMTileNode* Leaf, int X, int Y)
+{
+	EshyWMTileNode* Split = Leaf->Parent;
+	if (!Split)
+		return;
+
+	const EshyWMTileRect& Rect = Split->Rect;
+	if (Split->Split == TS_Horizontal && Rect.Width > 0)
+		SetRatio(Split, (float)(X - Rect.X) / Rect.Width);
+	else if (Split->Split == TS_Vertical && Rect.Height > 0)
+		SetRatio(Split, (float)(Y - Rect.Y) / Rect.Height);
+}
+
+void EshyWMTileLayout::SetRatio(EshyWMTileNode* Split, float Ratio)
+{
+	Ratio = std::clamp(Ratio, TILE_MIN_RATIO, TILE_MAX_RATIO);
+	if (Split->IsLeaf() || Split->Ratio == Ratio)
+		return;
+
+	Split->Ratio = Ratio;
+	Layout(Split, Split->Rect, true);
+}
+
+void EshyWMTileLayout::Layout(EshyWMTileNode* Node, const EshyWMTileRect& Rect, bool bForce)
+{
+	NodesLaidOut++;
+
+	if (Node->IsLeaf())
+	{
+		if (Rect != Node->Rect)
+		{
+			Node->Rect = Rect;
+			Place(Node->Client, Rect);
+		}
+		return;
+	}
+
+	if (!bForce && Rect == Node->Rect)
+		return;
+
+	Node->Rect = Rect;
+
+	EshyWMTileRect First = Rect;
+	EshyWMTileRect Second = Rect;
+	if (Node->Split == TS_Horizontal)
+	{
+		First.Width = (int)std::lround(Rect.Width * Node->Ratio);
+		Second.X += First.Width;
+		Second.Width -= First.Width;
+	}
+	else
+	{
+		First.Height = (int)std::lround(Rect.Height * Node->Ratio);
+		Second.Y += First.Height;
+		Second.Height -= First.Height;
+	}
+
+	Layout(Node->Children[0], First, false);
+	Layout(Node->Children[1], Second, false);
+}
+
+void EshyWMTileLayout::Replace(EshyWMTileNode* Old, EshyWMTileNode* New)
+{
+	if (!Old->Parent)
+		Root = New;
+	else if (Old->Parent->Children[0] == Old)
+		Old->Parent->Children[0] = New;
+	else
+		Old->Parent->Children[1] = New;
+}
+
+void EshyWMTileLayout::DestroyTree(EshyWMTileNode* Node)
+{
+	if (!Node)
+		return;
+
+	DestroyTree(Node->Children[0]);
+	DestroyTree(Node->Children[1]);
+	delete Node;
+}
@@ -4,6 +4,11 @@
 #include "Output.h"
 #include "Config.h"
 #include "Util.h"
+#include "HitTest.h"
+#include "Decoration.h"
+#include "Workspace.h"
+#include "SpecialWindow.h"
+#include "Switcher.h"
 
 #include "EshyIPC.h"
 
@@ -13,6 +18,7 @@
 extern "C"
 {
 #include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/types/wlr_scene.h>
 #include <wlr/util/edges.h>
@@ -23,8 +29,6 @@ extern "C"
 #undef static
 #undef class
 
-#include <nlohmann/json.hpp>
-
 #include <algorithm>
 #include <assert.h>
 
@@ -35,6 +39,7 @@ static void WindowRequestResize(struct wl_listener* listener, void* data);
 static void WindowRequestMaximize(struct wl_listener* listener, void* data);
 static void WindowRequestFullscreen(struct wl_listener* listener, void* data);
 static void WindowSetTitle(struct wl_listener* listener, void* data);
+static void WindowCommit(struct wl_listener* listener, void* data);
 
 static void XdgToplevelDestroy(struct wl_listener* listener, void* data);
 static void XdgToplevelSetAppId(struct wl_listener* listener, void* data);
@@ -48,6 +53,7 @@ static void XWindowCommit(struct wl_listener* listener, void* data);
 static void XRequestActivateWindow(struct wl_listener* listener, void* data);
 static void XRequestConfigureWindow(struct wl_listener* listener, void* data);
 static void XSetHints(struct wl_listener* listener, void* data);
+static void XSetClass(struct wl_listener* listener, void* data);
 
 EshyWMWindowBase* DesktopWindowAt(double lx, double ly, struct wlr_surface** surface, double* sx, double* sy)
 {
@@ -55,7 +61,23 @@ EshyWMWindowBase* DesktopWindowAt(double lx, double ly, struct wlr_surface** sur
 	*  we only care about surface nodes as we are specifically looking for a
 	*  surface in the surface tree of a eshywm_window.*/
 	struct wlr_scene_node* node = wlr_scene_node_at(&Server->Scene->tree.node, lx, ly, sx, sy);
-	if (node == NULL || node->type != WLR_SCENE_NODE_BUFFER)
+	return node ? WindowFromNode(node, surface) : NULL;
+}
+
+//The window a transient is for if that one is fullscreen, given the scene tree stored in the parent surface's data
+static EshyWMWindowBase* GetFullscreenParent(void* ParentScene)
+{
+	//Eshybar's tree carries a special window, not a window
+	if (!ParentScene || (Server->Eshybar && ParentScene == Server->Eshybar->SceneTree))
+		return nullptr;
+
+	EshyWMWindowBase* Parent = (EshyWMWindowBase*)((struct wlr_scene_tree*)ParentScene)->node.data;
+	return Parent && Parent->WindowState == ESHYWM_WINDOW_STATE_FULLSCREEN ? Parent : nullptr;
+}
+
+EshyWMWindowBase* WindowFromNode(struct wlr_scene_node* node, struct wlr_surface** surface)
+{
+	if (node->type != WLR_SCENE_NODE_BUFFER)
 		return NULL;
 
 	struct wlr_scene_buffer* scene_buffer = wlr_scene_buffer_from_node(node);
@@ -75,66 +97,183 @@ EshyWMWindowBase* DesktopWindowAt(double lx, double ly, struct wlr_surface** sur
 }
 
 
+EshyWMMessage EshyWMWindowBase::MakeWindowMessage(EEshyWMAction Action) const
+{
+	EshyWMMessage Message = MakeMessage(Action, CLIENT_COMPOSITOR, Handle);
+	CopyBoundedString(Message.AppID, GetAppID());
+	CopyBoundedString(Message.Title, GetTitle());
+	return Message;
+}
+
+EshyWMWindowRecord EshyWMWindowBase::MakeWindowRecord() const
+{
+	EshyWMWindowRecord Record = {};
+	Record.ID = Handle;
+	CopyBoundedString(Record.AppID, GetAppID());
+	CopyBoundedString(Record.Title, GetTitle());
+	Record.State = WindowState;
+	Record.bFocused = Server->FocusedWindow == this;
+	Record.Output = -1;
+
+	//Unmapped windows have no output yet
+	for (size_t i = 0; i < Server->OutputList.size(); ++i)
+	{
+		if (Output && Server->OutputList[i] == Output)
+		{
+			Record.Output = (int32_t)i;
+			break;
+		}
+	}
+
+	return Record;
+}
+
 void EshyWMWindowBase::FocusWindow()
 {
 	//Don't re-focus an already focused surface
 	if (Server->FocusedWindow == this)
 		return;
 
-	if (Server->FocusedWindow)
-		Server->FocusedWindow->UnfocusWindow();
+	//Focusing a hidden window brings it back into view
+	if (WindowState == ESHYWM_WINDOW_STATE_MINIMIZED)
+		MinimizeWindow(false);
+	if (Workspace && !Workspace->IsActive())
+		Server->ShowWorkspace(Workspace);
+
+	EshyWMWindowBase* PreviousWindow = Server->FocusedWindow;
+	if (PreviousWindow)
+		PreviousWindow->UnfocusWindow();
 
 	Server->FocusedWindow = this;
 
-	auto pos = std::find(Server->WindowList.begin(), Server->WindowList.end(), this);
-	if(pos != Server->WindowList.end())
-	{
-		auto it = Server->WindowList.begin() + std::distance(Server->WindowList.begin(), pos);
-    	std::rotate(Server->WindowList.begin(), it, it + 1);
-	}
+	//Most recently focused goes to the front
+	wl_list_remove(&FocusLink);
+	wl_list_insert(&Server->FocusOrder, &FocusLink);
 
-	for(int i = 0; i < 4; ++i)
-		wlr_scene_rect_set_color(Border[i], EshyWMConfig::ESHYWM_COLOR_BORDER_FOCUSED);
+	if (Decoration)
+		Decoration->SetFocused(true);
 
 	//Move the window to the front
-	wlr_scene_node_raise_to_top(&Scene->node);
+	Server->RaiseWindow(this);
+
+	if (PreviousWindow)
+		Server->NotifyWindowEvent(PreviousWindow->MakeWindowMessage(ACTION_UNFOCUS_WINDOW));
+
+	Server->NotifyWindowEvent(MakeWindowMessage(ACTION_FOCUS_WINDOW));
 }
 
 void EshyWMWindowBase::UnfocusWindow()
 {
-	for(int i = 0; i < 4; ++i)
-		wlr_scene_rect_set_color(Border[i], EshyWMConfig::ESHYWM_COLOR_BORDER_NORMAL);
+	if (Decoration)
+		Decoration->SetFocused(false);
 }
 
-void EshyWMWindowBase::CreateBorder()
+void EshyWMWindowBase::MinimizeWindow(bool b_minimize)
 {
-	UpdateWindowGeometry();
+	if (!Scene || b_minimize == (WindowState == ESHYWM_WINDOW_STATE_MINIMIZED))
+		return;
+
+	//Not drawn, no frame callbacks and no input while disabled, without the client having to go through an unmap
+	wlr_scene_node_set_enabled(&Scene->node, !b_minimize);
+	Server->HitTester->UpdateWindow(this);
 
-	for(int i = 0; i < 4; ++i)
+	if(b_minimize)
 	{
-		Border[i] = wlr_scene_rect_create(Scene, 0, 0, EshyWMConfig::ESHYWM_COLOR_BORDER_NORMAL);
-		Border[i]->node.data = this;
+		PreMinimizeState = WindowState;
+		bPreMinimizeTiled = TileNode != nullptr;
+		Server->UntileWindow(this);
+		WindowState = ESHYWM_WINDOW_STATE_MINIMIZED;
+
+		//Its dialogs no longer need to be over everything
+		if (PreMinimizeState == ESHYWM_WINDOW_STATE_FULLSCREEN && Workspace)
+			Workspace->ReleaseTransients();
+
+		if (Server->FocusedWindow == this)
+		{
+			Server->ResetCursorMode();
+			Server->FocusMostRecent(Workspace);
+		}
+
+		Server->NotifyWindowEvent(MakeWindowMessage(ACTION_MINIMIZE_WINDOW));
 	}
+	else
+	{
+		WindowState = PreMinimizeState;
 
-	UpdateBorder();
+		//Fullscreen windows get their tile back without being placed in it, a maximized one is put back over the output afterwards
+		if (bPreMinimizeTiled)
+			Server->TileWindow(this);
+		if (WindowState == ESHYWM_WINDOW_STATE_MAXIMIZED)
+			MaximizeWindow(true);
+
+		Server->NotifyWindowEvent(MakeWindowMessage(ACTION_UPDATE_WINDOW));
+	}
+}
+
+bool EshyWMWindowBase::IsMapped() const
+{
+	struct wlr_surface* Surface = GetSurface();
+	return Scene && Surface && Surface->mapped;
+}
+
+void EshyWMWindowBase::SetPosition(int x, int y)
+{
+	wlr_scene_node_set_position(&Scene->node, x, y);
+	UpdateOutput();
+	Server->HitTester->UpdateWindow(this);
+}
+
+void EshyWMWindowBase::UpdateOutput()
+{
+	const double CenterX = Scene->node.x + WindowGeometry.width / 2.0;
+	const double CenterY = Scene->node.y + WindowGeometry.height / 2.0;
+	if (!Output || !wlr_box_contains_point(&Output->LayoutBox, CenterX, CenterY))
+		Output = Server->GetOutputAt(CenterX, CenterY);
+
+	if (Output && Workspace && Workspace->Output != Output && Server->FocusedWindow == this && Server->CursorMode == ESHYWM_CURSOR_MOVE)
+		Server->MoveWindowToWorkspace(this, Output->ActiveWorkspace);
+}
+
+void EshyWMWindowBase::RequestResize(const EshyWMResizeRequest& Request)
+{
+	if (ResizeThrottle.Queue(Request))
+		SendPendingResize();
+}
+
+void EshyWMWindowBase::SendPendingResize()
+{
+	ResizeThrottle.Sent(SendResizeConfigure(ResizeThrottle.TakePending()));
+	Server->ResizeConfiguresSent++;
+}
+
+void EshyWMWindowBase::FinishResize()
+{
+	Server->ResizeConfiguresCommitted++;
+	ApplyResize(ResizeThrottle.GetInFlight());
+
+	//Everything requested while the client was drawing collapses into its newest size
+	if (ResizeThrottle.HasPending())
+		SendPendingResize();
+}
+
+void EshyWMWindowBase::CreateBorder()
+{
+	UpdateWindowGeometry();
+
+	if (!Decoration)
+		Decoration = new EshyWMDecoration(Scene, WindowGeometry.width, WindowGeometry.height, Server->FocusedWindow == this);
 }
 
 void EshyWMWindowBase::DestroyBorder()
 {
-	for(int i = 0; i < 4; ++i)
-		wlr_scene_node_destroy(&Border[i]->node);
+	delete Decoration;
+	Decoration = nullptr;
 }
 
 void EshyWMWindowBase::UpdateBorder()
 {
-	wlr_scene_rect_set_size(Border[BS_TOP], WindowGeometry.width, EshyWMConfig::ESHYWM_BORDER_WIDTH);
-	wlr_scene_rect_set_size(Border[BS_BOTTOM], WindowGeometry.width, EshyWMConfig::ESHYWM_BORDER_WIDTH);
-	wlr_scene_rect_set_size(Border[BS_LEFT], EshyWMConfig::ESHYWM_BORDER_WIDTH, WindowGeometry.height);
-	wlr_scene_rect_set_size(Border[BS_RIGHT], EshyWMConfig::ESHYWM_BORDER_WIDTH, WindowGeometry.height + EshyWMConfig::ESHYWM_BORDER_WIDTH);
-
-	wlr_scene_node_set_position(&Border[BS_BOTTOM]->node, 0, WindowGeometry.height);
-	wlr_scene_node_set_position(&Border[BS_LEFT]->node, 0, 0);
-	wlr_scene_node_set_position(&Border[BS_RIGHT]->node, WindowGeometry.width, 0);
+	if (Decoration)
+		Decoration->SetSize(WindowGeometry.width, WindowGeometry.height);
 }
 
 
@@ -157,6 +296,21 @@ EshyWMWindow::EshyWMWindow(struct wlr_xdg_surface* XdgSurface)
 	add_listener(&SetAppIdListener, XdgToplevelSetAppId, &XdgToplevel->events.set_app_id);
 }
 
+struct wlr_surface* EshyWMWindow::GetSurface() const
+{
+	return XdgToplevel->base->surface;
+}
+
+const char* EshyWMWindow::GetAppID() const
+{
+	return XdgToplevel->app_id ? XdgToplevel->app_id : "NO_APP_ID";
+}
+
+const char* EshyWMWindow::GetTitle() const
+{
+	return XdgToplevel->title ? XdgToplevel->title : "NO_TITLE";
+}
+
 void EshyWMWindow::FocusWindow()
 {
 	//Don't re-focus an already focused surface
@@ -223,17 +377,16 @@ void EshyWMWindow::ProcessCursorMove(uint32_t time)
 {
 	WindowGeometry.x = Server->Cursor->x - Server->grab_x;
 	WindowGeometry.y = Server->Cursor->y - Server->grab_y;
-	wlr_scene_node_set_position(&Scene->node, Server->Cursor->x - Server->grab_x, Server->Cursor->y - Server->grab_y);
+	SetPosition(Server->Cursor->x - Server->grab_x, Server->Cursor->y - Server->grab_y);
 }
 
 void EshyWMWindow::ProcessCursorResize(uint32_t time)
 {
 	if(Server->ResizeEdges == 0)
 	{
-		WindowGeometry.width = std::max((double)100, Server->GrabGeobox.width + (Server->Cursor->x - Server->grab_x));
-		WindowGeometry.height = std::max((double)100, Server->GrabGeobox.height + (Server->Cursor->y - Server->grab_y));
-		wlr_xdg_toplevel_set_size(XdgToplevel, WindowGeometry.width, WindowGeometry.height);
-		UpdateBorder();
+		const int Width = std::max((double)100, Server->GrabGeobox.width + (Server->Cursor->x - Server->grab_x));
+		const int Height = std::max((double)100, Server->GrabGeobox.height + (Server->Cursor->y - Server->grab_y));
+		RequestResize({Server->GrabGeobox.x, Server->GrabGeobox.y, Width, Height, 0});
 		return;
 	}
 
@@ -269,19 +422,37 @@ void EshyWMWindow::ProcessCursorResize(uint32_t time)
 			new_right = new_left + 1;
 	}
 
+	RequestResize({new_left, new_top, new_right - new_left, new_bottom - new_top, Server->ResizeEdges});
+}
+
+uint32_t EshyWMWindow::SendResizeConfigure(const EshyWMResizeRequest& Request)
+{
+	return wlr_xdg_toplevel_set_size(XdgToplevel, Request.Width, Request.Height);
+}
+
+void EshyWMWindow::ApplyResize(const EshyWMResizeRequest& Request)
+{
 	struct wlr_box geo_box;
 	wlr_xdg_surface_get_geometry(XdgToplevel->base, &geo_box);
-	wlr_scene_node_set_position(&Scene->node, new_left - geo_box.x, new_top - geo_box.y);
+	WindowGeometry.width = geo_box.width;
+	WindowGeometry.height = geo_box.height;
 
-	int new_width = new_right - new_left;
-	int new_height = new_bottom - new_top;
-	wlr_xdg_toplevel_set_size(XdgToplevel, new_width, new_height);
+	//The client may not have taken the exact size, keep the edges that are not being dragged where they were
+	const int Left = (Request.Edges & WLR_EDGE_LEFT) ? Request.X + Request.Width - geo_box.width : Request.X;
+	const int Top = (Request.Edges & WLR_EDGE_TOP) ? Request.Y + Request.Height - geo_box.height : Request.Y;
+	SetPosition(Left - geo_box.x, Top - geo_box.y);
+	UpdateBorder();
 }
 
 void EshyWMWindow::FullscreenWindow(bool b_fullscreen)
 {
+	EshyWMOutput* WindowOutput = Server->GetWindowOutput(this);
+
 	if (b_fullscreen)
 	{
+		if (!WindowOutput)
+			return;
+
 		if(WindowState != ESHYWM_WINDOW_STATE_MAXIMIZED && WindowState != ESHYWM_WINDOW_STATE_FULLSCREEN)
 		{
 			struct wlr_box geo_box;
@@ -291,32 +462,55 @@ void EshyWMWindow::FullscreenWindow(bool b_fullscreen)
 			SavedGeo.y += Scene->node.y;
 		}
 		
-		int width;
-		int height;
-		wlr_output_effective_resolution(Server->OutputList[0]->WlrOutput, &width, &height);
+		const struct wlr_box& Box = WindowOutput->LayoutBox;
 
-		wlr_xdg_toplevel_set_size(XdgToplevel, width, height);
-		wlr_scene_node_set_position(&Scene->node, 0, 0);
-
-		DestroyBorder();
+		//Supersedes any interactive resize still waiting on the client
+		ResizeThrottle.Reset();
+		wlr_xdg_toplevel_set_fullscreen(XdgToplevel, true);
+		wlr_xdg_toplevel_set_size(XdgToplevel, Box.width, Box.height);
 
+		/*Nothing may be drawn over the window for its buffer to go straight to the display, so it leaves its layer for the fullscreen
+		*  one and loses its frame. Everything under the opaque surface is culled by the scene*/
+		wlr_scene_node_reparent(&Scene->node, Server->GetFullscreenLayer(Workspace));
 		WindowState = ESHYWM_WINDOW_STATE_FULLSCREEN;
+		SetPosition(Box.x, Box.y);
+		DestroyBorder();
+		Server->RaiseWindow(this);
 	}
 	else if (WindowState == ESHYWM_WINDOW_STATE_FULLSCREEN)
 	{
-		wlr_xdg_toplevel_set_size(XdgToplevel, SavedGeo.width, SavedGeo.height);
-		wlr_scene_node_set_position(&Scene->node, SavedGeo.x, SavedGeo.y);
+		ResizeThrottle.Reset();
+		wlr_xdg_toplevel_set_fullscreen(XdgToplevel, false);
+		wlr_scene_node_reparent(&Scene->node, Server->GetWindowLayer(Workspace, TileNode != nullptr));
+		WindowState = ESHYWM_WINDOW_STATE_NORMAL;
 
-		CreateBorder();
+		if (TileNode)
+			Workspace->PlaceTiled(this);
+		else
+		{
+			wlr_xdg_toplevel_set_size(XdgToplevel, SavedGeo.width, SavedGeo.height);
+			SetPosition(SavedGeo.x, SavedGeo.y);
+		}
 
-		WindowState = ESHYWM_WINDOW_STATE_NORMAL;
+		CreateBorder();
+		if (Workspace)
+			Workspace->ReleaseTransients();
 	}
+	else
+		return;
+
+	Server->NotifyWindowEvent(MakeWindowMessage(ACTION_UPDATE_WINDOW));
 }
 
 void EshyWMWindow::MaximizeWindow(bool b_maximize)
 {
+	EshyWMOutput* WindowOutput = Server->GetWindowOutput(this);
+
 	if (b_maximize)
 	{
+		if (!WindowOutput)
+			return;
+
 		if(WindowState != ESHYWM_WINDOW_STATE_MAXIMIZED && WindowState != ESHYWM_WINDOW_STATE_FULLSCREEN)
 		{
 			struct wlr_box geo_box;
@@ -326,36 +520,29 @@ void EshyWMWindow::MaximizeWindow(bool b_maximize)
 			SavedGeo.y += Scene->node.y;
 		}
 
-		int width;
-		int height;
-		wlr_output_effective_resolution(Server->OutputList[0]->WlrOutput, &width, &height);
+		const struct wlr_box& Box = WindowOutput->UsableArea;
 
-		wlr_xdg_toplevel_set_size(XdgToplevel, width, height - 50.0f);
-		wlr_scene_node_set_position(&Scene->node, 0, 0);
+		//Supersedes any interactive resize still waiting on the client
+		ResizeThrottle.Reset();
+		wlr_xdg_toplevel_set_size(XdgToplevel, Box.width, Box.height);
+		SetPosition(Box.x, Box.y);
 
 		WindowState = ESHYWM_WINDOW_STATE_MAXIMIZED;
 	}
 	else if (WindowState == ESHYWM_WINDOW_STATE_MAXIMIZED)
 	{
+		ResizeThrottle.Reset();
 		wlr_xdg_toplevel_set_size(XdgToplevel, SavedGeo.width, SavedGeo.height);
-		wlr_scene_node_set_position(&Scene->node, SavedGeo.x, SavedGeo.y);
+		SetPosition(SavedGeo.x, SavedGeo.y);
 
 		WindowState = ESHYWM_WINDOW_STATE_NORMAL;
 	}
-}
-
-void EshyWMWindow::MinimizeWindow(bool b_minimize)
-{
-	if (!XdgToplevel || !XdgToplevel->base || !XdgToplevel->base->surface)
+	else
 		return;
 
-	if(b_minimize)
-		wlr_surface_unmap(XdgToplevel->base->surface);
-	else
-		wlr_surface_map(XdgToplevel->base->surface);
+	Server->NotifyWindowEvent(MakeWindowMessage(ACTION_UPDATE_WINDOW));
 }
 
-
 EshyWMXWindow::EshyWMXWindow(struct wlr_xwayland_surface* XSurface)
 	: EshyWMWindowBase()
 {
@@ -375,6 +562,24 @@ EshyWMXWindow::EshyWMXWindow(struct wlr_xwayland_surface* XSurface)
 	add_listener(&XActivateListener, XRequestActivateWindow, &XSurface->events.request_activate);
 	add_listener(&XConfigureListener, XRequestConfigureWindow, &XSurface->events.request_configure);
 	add_listener(&XSetHintsListener, XSetHints, &XSurface->events.set_hints);
+	add_listener(&XSetClassListener, XSetClass, &XSurface->events.set_class);
+}
+
+struct wlr_surface* EshyWMXWindow::GetSurface() const
+{
+	return XWaylandSurface->surface;
+}
+
+const char* EshyWMXWindow::GetAppID() const
+{
+#define class wlr
+	return XWaylandSurface->class ? XWaylandSurface->class : "NO_APP_CLASS";
+#undef class
+}
+
+const char* EshyWMXWindow::GetTitle() const
+{
+	return XWaylandSurface->title ? XWaylandSurface->title : "NO_TITLE";
 }
 
 void EshyWMXWindow::FocusWindow()
@@ -451,25 +656,35 @@ void EshyWMXWindow::ProcessCursorMove(uint32_t time)
 {
 	WindowGeometry.x = Server->Cursor->x - Server->grab_x;
 	WindowGeometry.y = Server->Cursor->y - Server->grab_y;
-	wlr_scene_node_set_position(&Scene->node, WindowGeometry.x, WindowGeometry.y);
+	SetPosition(WindowGeometry.x, WindowGeometry.y);
 }
 
 void EshyWMXWindow::ProcessCursorResize(uint32_t time)
 {
-	WindowGeometry.width = std::max((double)100, Server->GrabGeobox.width + (Server->Cursor->x - Server->grab_x));
-	WindowGeometry.height = std::max((double)100, Server->GrabGeobox.height + (Server->Cursor->y - Server->grab_y));
-	wlr_xwayland_surface_configure(XWaylandSurface, Server->GrabGeobox.x, Server->GrabGeobox.y, WindowGeometry.width, WindowGeometry.height);
+	const int Width = std::max((double)100, Server->GrabGeobox.width + (Server->Cursor->x - Server->grab_x));
+	const int Height = std::max((double)100, Server->GrabGeobox.height + (Server->Cursor->y - Server->grab_y));
+	RequestResize({Server->GrabGeobox.x, Server->GrabGeobox.y, Width, Height, 0});
+}
+
+uint32_t EshyWMXWindow::SendResizeConfigure(const EshyWMResizeRequest& Request)
+{
+	//X has no configure serials, the next commit is taken as the answer
+	wlr_xwayland_surface_configure(XWaylandSurface, Request.X, Request.Y, Request.Width, Request.Height);
+	return 0;
+}
+
+void EshyWMXWindow::ApplyResize(const EshyWMResizeRequest& Request)
+{
+	WindowGeometry.width = Request.Width;
+	WindowGeometry.height = Request.Height;
 	UpdateBorder();
 }
 
 
 static void WindowDestroy(EshyWMWindowBase* window)
 {
-	nlohmann::json WindowRemoveInfo;
-	WindowRemoveInfo["action"] = ACTION_REMOVE_WINDOW;
-	WindowRemoveInfo["sender_client"] = CLIENT_COMPOSITOR;
-	WindowRemoveInfo["window_id"] = (uint64_t)window;
-	EshyIPC::InsertIntoMemory(EshybarShmID, WindowRemoveInfo.dump());
+	Server->CancelMetadataUpdate(window);
+	Server->NotifyWindowEvent(MakeMessage(ACTION_REMOVE_WINDOW, CLIENT_COMPOSITOR, window->Handle));
 
 	wl_list_remove(&window->DestroyListener.link);
 	wl_list_remove(&window->RequestMoveListener.link);
@@ -477,13 +692,8 @@ static void WindowDestroy(EshyWMWindowBase* window)
 	wl_list_remove(&window->RequestMaximizeListener.link);
 	wl_list_remove(&window->RequestFullscreenListener.link);
 	wl_list_remove(&window->SetTitleListener.link);
-	free(window);
 
-	auto pos = std::find(Server->WindowList.begin(), Server->WindowList.end(), window);
-	if(pos != Server->WindowList.end())
-	{
-		Server->WindowList.erase(Server->WindowList.begin() + std::distance(Server->WindowList.begin(), pos));
-	}
+	Server->RemoveWindow(window);
 }
 
 void WindowMap(struct wl_listener* listener, void* data)
@@ -491,14 +701,32 @@ void WindowMap(struct wl_listener* listener, void* data)
 	/*Called when the surface is mapped, or ready to display on-screen.*/
 	EshyWMWindow* window = wl_container_of(listener, window, MapListener);
 
-	window->Scene = wlr_scene_tree_create(Server->Layers[L_Float]);
+	//Dialogs of a fullscreen window would be hidden under it anywhere but in its layer
+	EshyWMWindowBase* FullscreenParent = GetFullscreenParent(window->XdgToplevel->parent ? window->XdgToplevel->parent->base->data : nullptr);
+
+	window->Workspace = FullscreenParent ? FullscreenParent->Workspace : Server->GetCurrentWorkspace();
+	window->Scene = wlr_scene_tree_create(FullscreenParent ? Server->GetFullscreenLayer(window->Workspace) : Server->GetWindowLayer(window->Workspace, EshyWMConfig::ESHYWM_TILING));
 	wlr_scene_node_set_enabled(&window->Scene->node, true);
 	window->SceneTree = wlr_scene_subsurface_tree_create(window->Scene, window->XdgToplevel->base->surface);
 	window->XdgToplevel->base->data = window->Scene;
 	window->Scene->node.data = window->SceneTree->node.data = window;
 
+	add_listener(&window->CommitListener, WindowCommit, &window->XdgToplevel->base->surface->events.commit);
+
+	//The new scene node starts on top of its layer
+	wl_list_insert(&Server->StackingOrder, &window->StackLink);
+
 	window->CreateBorder();
+	if (EshyWMConfig::ESHYWM_TILING && !FullscreenParent)
+		Server->TileWindow(window);
+	else if (window->Workspace)
+	{
+		//New floating windows open in the middle of the output the cursor is on
+		const struct wlr_box& Area = window->Workspace->Output->UsableArea;
+		window->SetPosition(Area.x + std::max((Area.width - window->WindowGeometry.width) / 2, 0), Area.y + std::max((Area.height - window->WindowGeometry.height) / 2, 0));
+	}
 	window->FocusWindow();
+	Server->HitTester->UpdateWindow(window);
 }
 
 void WindowUnmap(struct wl_listener* listener, void* data)
@@ -507,6 +735,19 @@ void WindowUnmap(struct wl_listener* listener, void* data)
 	EshyWMWindow* window = wl_container_of(listener, window, UnmapListener);
 	window->DestroyBorder();
 
+	wl_list_remove(&window->CommitListener.link);
+	Server->HitTester->RemoveWindow(window);
+	Server->UntileWindow(window);
+	window->ResizeThrottle.Reset();
+
+	if (window->Workspace)
+		window->Workspace->ReleaseTransients();
+
+	//Nothing to stack or switch to until it maps again
+	wl_list_remove(&window->StackLink);
+	wl_list_init(&window->StackLink);
+	Server->Switcher->WindowRemoved(window);
+
 	/*Reset the cursor mode if the grabbed window was unmapped.*/
 	if (window == Server->FocusedWindow)
 	{
@@ -542,7 +783,18 @@ void WindowRequestFullscreen(struct wl_listener* listener, void* data)
 
 void WindowSetTitle(struct wl_listener* listener, void* data)
 {
-	
+	EshyWMWindowBase* window = wl_container_of(listener, window, SetTitleListener);
+	Server->QueueMetadataUpdate(window);
+}
+
+void WindowCommit(struct wl_listener* listener, void* data)
+{
+	EshyWMWindow* window = wl_container_of(listener, window, CommitListener);
+
+	if (window->ResizeThrottle.Committed(window->XdgToplevel->base->current.configure_serial))
+		window->FinishResize();
+
+	Server->HitTester->WindowCommitted(window);
 }
 
 
@@ -558,7 +810,8 @@ void XdgToplevelDestroy(struct wl_listener* listener, void* data)
 
 void XdgToplevelSetAppId(struct wl_listener* listener, void* data)
 {
-	
+	EshyWMWindow* window = wl_container_of(listener, window, SetAppIdListener);
+	Server->QueueMetadataUpdate(window);
 }
 
 
@@ -580,7 +833,10 @@ void XWindowMap(struct wl_listener* listener, void* data)
 {
 	EshyWMXWindow* window = wl_container_of(listener, window, MapListener);
 
-	window->Scene = wlr_scene_tree_create(Server->Layers[L_Float]);
+	EshyWMWindowBase* FullscreenParent = window->WindowType == WT_X11Managed && window->XWaylandSurface->parent ? GetFullscreenParent(window->XWaylandSurface->parent->data) : nullptr;
+
+	window->Workspace = window->WindowType != WT_X11Managed ? nullptr : FullscreenParent ? FullscreenParent->Workspace : Server->GetCurrentWorkspace();
+	window->Scene = wlr_scene_tree_create(FullscreenParent ? Server->GetFullscreenLayer(window->Workspace) : Server->GetWindowLayer(window->Workspace, EshyWMConfig::ESHYWM_TILING));
 	wlr_scene_node_set_enabled(&window->Scene->node, true);
 	window->SceneTree = wlr_scene_subsurface_tree_create(window->Scene, window->XWaylandSurface->surface);
 	window->XWaylandSurface->data = window->Scene;
@@ -589,17 +845,26 @@ void XWindowMap(struct wl_listener* listener, void* data)
 	//Attach commit listener here because xwayland map and unmap can change the underlying wlr_surface
 	add_listener(&window->XCommitListener, XWindowCommit, &window->XWaylandSurface->surface->events.commit);
 
+	//The new scene node starts on top of its layer
+	wl_list_insert(&Server->StackingOrder, &window->StackLink);
+
 	if(window->WindowType == WT_X11Managed)
 	{
 		window->CreateBorder();
+		if (EshyWMConfig::ESHYWM_TILING && !FullscreenParent)
+			Server->TileWindow(window);
+		else
+			window->UpdateOutput();
 		window->FocusWindow();
+		Server->HitTester->UpdateWindow(window);
 	}
 	else
 	{
-		wlr_scene_node_reparent(&window->Scene->node, Server->Layers[L_Float]);
+		wlr_scene_node_reparent(&window->Scene->node, Server->Layers[L_Unmanaged]);
+		Server->RaiseWindow(window);
 		window->WindowGeometry.x = Server->Cursor->x;
 		window->WindowGeometry.y = Server->Cursor->y;
-		wlr_scene_node_set_position(&window->Scene->node, window->WindowGeometry.x, window->WindowGeometry.y);
+		window->SetPosition(window->WindowGeometry.x, window->WindowGeometry.y);
 	}
 }
 
@@ -611,6 +876,17 @@ void XWindowUnmap(struct wl_listener* listener, void* data)
 		window->DestroyBorder();
 
 	wl_list_remove(&window->XCommitListener.link);
+	Server->HitTester->RemoveWindow(window);
+	Server->UntileWindow(window);
+	window->ResizeThrottle.Reset();
+
+	if (window->Workspace)
+		window->Workspace->ReleaseTransients();
+
+	//Nothing to stack or switch to until it maps again
+	wl_list_remove(&window->StackLink);
+	wl_list_init(&window->StackLink);
+	Server->Switcher->WindowRemoved(window);
 
 	/*Reset the cursor mode if the grabbed window was unmapped.*/
 	if (window == Server->FocusedWindow)
@@ -627,12 +903,18 @@ void XWaylandDestroy(struct wl_listener* listener, void* data)
 	wl_list_remove(&window->XActivateListener.link);
 	wl_list_remove(&window->XConfigureListener.link);
 	wl_list_remove(&window->XSetHintsListener.link);
+	wl_list_remove(&window->XSetClassListener.link);
 	WindowDestroy(window);
 }
 
 void XWindowCommit(struct wl_listener* listener, void* data)
 {
-	
+	EshyWMXWindow* window = wl_container_of(listener, window, XCommitListener);
+
+	if (window->ResizeThrottle.Committed())
+		window->FinishResize();
+
+	Server->HitTester->WindowCommitted(window);
 }
 
 void XRequestActivateWindow(struct wl_listener* listener, void* data)
@@ -653,4 +935,10 @@ void XRequestConfigureWindow(struct wl_listener* listener, void* data)
 void XSetHints(struct wl_listener* listener, void* data)
 {
 	EshyWMXWindow* window = wl_container_of(listener, window, XSetHintsListener);
+}
+
+void XSetClass(struct wl_listener* listener, void* data)
+{
+	EshyWMXWindow* window = wl_container_of(listener, window, XSetClassListener);
+	Server->QueueMetadataUpdate(window);
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "Workspace.h"
+#include "Server.h"
+#include "Window.h"
+#include "Config.h"
+#include "TileLayout.h"
+#include "HitTest.h"
+
+#define static
+
+extern "C"
+{
+#include <wlr/types/wlr_scene.h>
+}
+
+#undef static
+
+#include <algorithm>
+
+static void PlaceTiledWindow(void* Client, const EshyWMTileRect& Rect)
+{
+	EshyWMWindowBase* Window = (EshyWMWindowBase*)Client;
+
+	//The tile is remembered in the node, PlaceTiled puts it back there afterwards
+	if (Window->WindowState == ESHYWM_WINDOW_STATE_FULLSCREEN)
+		return;
+
+	//The tile includes the border
+	const int BorderWidth = EshyWMConfig::ESHYWM_BORDER_WIDTH;
+	const int X = Rect.X + BorderWidth;
+	const int Y = Rect.Y + BorderWidth;
+
+	Window->WindowGeometry.x = X;
+	Window->WindowGeometry.y = Y;
+	Window->SetPosition(X, Y);
+	Window->RequestResize({X, Y, std::max(Rect.Width - 2 * BorderWidth, 1), std::max(Rect.Height - 2 * BorderWidth, 1), 0});
+}
+
+EshyWMWorkspace::EshyWMWorkspace(EshyWMOutput* _Output, int _Index)
+	: Output(_Output)
+	, Index(_Index)
+	, TileTree(wlr_scene_tree_create(Server->Layers[L_Tile]))
+	, FloatTree(wlr_scene_tree_create(Server->Layers[L_Float]))
+	, FullscreenTree(wlr_scene_tree_create(Server->Layers[L_Fullscreen]))
+	, TileLayout(new EshyWMTileLayout(PlaceTiledWindow))
+	, bActive(true)
+{
+	SetActive(false);
+}
+
+EshyWMWorkspace::~EshyWMWorkspace()
+{
+	delete TileLayout;
+	wlr_scene_node_destroy(&TileTree->node);
+	wlr_scene_node_destroy(&FloatTree->node);
+	wlr_scene_node_destroy(&FullscreenTree->node);
+}
+
+void EshyWMWorkspace::SetActive(bool _bActive)
+{
+	if (_bActive == bActive)
+		return;
+
+	bActive = _bActive;
+	wlr_scene_node_set_enabled(&TileTree->node, bActive);
+	wlr_scene_node_set_enabled(&FloatTree->node, bActive);
+	wlr_scene_node_set_enabled(&FullscreenTree->node, bActive);
+}
+
+bool EshyWMWorkspace::HasFullscreenWindow() const
+{
+	struct wlr_scene_node* Node;
+	wl_list_for_each(Node, &FullscreenTree->children, link)
+	{
+		const EshyWMWindowBase* Window = (const EshyWMWindowBase*)Node->data;
+		if (Window && Window->WindowState == ESHYWM_WINDOW_STATE_FULLSCREEN && Window->IsMapped())
+			return true;
+	}
+
+	return false;
+}
+
+void EshyWMWorkspace::ReleaseTransients()
+{
+	if (HasFullscreenWindow())
+		return;
+
+	struct wlr_scene_node* Node;
+	struct wlr_scene_node* Next;
+	wl_list_for_each_safe(Node, Next, &FullscreenTree->children, link)
+	{
+		EshyWMWindowBase* Window = (EshyWMWindowBase*)Node->data;
+		if (!Window || Window->WindowState == ESHYWM_WINDOW_STATE_FULLSCREEN)
+			continue;
+
+		wlr_scene_node_reparent(Node, FloatTree);
+		Server->HitTester->UpdateWindow(Window);
+	}
+}
+
+void EshyWMWorkspace::PlaceTiled(EshyWMWindowBase* Window)
+{
+	if (Window->TileNode)
+		PlaceTiledWindow(Window, Window->TileNode->Rect);
+}
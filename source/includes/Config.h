@@ -6,6 +6,9 @@
 #include <unordered_map>
 #include <cstdint>
 
+//max_render_time=auto, the deadline follows measured render times
+#define ESHYWM_MAX_RENDER_TIME_AUTO -1
+
 struct EshyWMMonitorInfo
 {
     std::string Name;
@@ -15,6 +18,9 @@ struct EshyWMMonitorInfo
     int OffsetX;
     int OffsetY;
     float Scale;
+    bool bAdaptiveSync;
+    //Milliseconds before vblank to start rendering, 0 renders as soon as the frame event fires
+    int MaxRenderTime;
 };
 
 namespace EshyWMConfig
@@ -29,6 +35,15 @@ extern float ESHYWM_COLOR_BORDER_FOCUSED[4];
 
 extern int ESHYWM_BORDER_WIDTH;
 
+//Minimum milliseconds between two title/app id updates for the same window, 0 allows one every frame
+extern int ESHYWM_METADATA_UPDATE_INTERVAL;
+
+//Apply interactive move/resize once per output frame with the latest cursor position instead of on every motion event
+extern bool ESHYWM_COALESCE_GRAB_MOTION;
+
+//Map new windows into the tiling layout on L_Tile instead of floating
+extern bool ESHYWM_TILING;
+
 void InitializeKeys();
 void ReadConfigFromFile(const std::string& ConfigFilePath);
 
@@ -0,0 +1,29 @@
+#pragma once
+
+/*A window's frame as four scene buffers in a tree behind its surfaces, one per edge. Every edge shows one of two shared 1x1 buffers,
+*  normal or focused, stretched with wlr_scene_buffer_set_dest_size to its strip. Nothing is drawn behind the window itself, so
+*  translucent clients show what is under them, and the opaque hint of each strip only ever covers that strip. Resizing damages the
+*  strips that moved, recoloring only the strips.*/
+class EshyWMDecoration
+{
+public:
+
+	EshyWMDecoration(struct wlr_scene_tree* Parent, int _Width, int _Height, bool _bFocused);
+	~EshyWMDecoration();
+
+	//Size of the window the frame goes around, the frame itself extends the border width past it
+	void SetSize(int _Width, int _Height);
+	void SetFocused(bool _bFocused);
+
+	//Releases the shared buffers, once every decoration is gone
+	static void DestroySharedBuffers();
+
+private:
+
+	struct wlr_scene_tree* Tree;
+	//Top, bottom, left, right
+	struct wlr_scene_buffer* Edges[4];
+	int Width;
+	int Height;
+	bool bFocused;
+};
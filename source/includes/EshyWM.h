@@ -1,4 +1,18 @@
-
 #pragma once
 
+#include "EshyIPC.h"
+#include "Shared.h"
+
 extern int EshybarShmID;
+
+//Compositor to Eshybar and Eshybar to compositor halves of EshybarShmID
+extern EshyIPC::Channel<EshyWMMessage> EshybarSendChannel;
+extern EshyIPC::Channel<EshyWMMessage> EshybarReceiveChannel;
+
+//Window events published once for every panel and tool following the compositor
+extern int EventBroadcastShmID;
+extern EshyIPC::BroadcastChannel<EshyWMMessage> EventBroadcast;
+
+//Every window's current record plus a log of recent changes, mapped read only by Eshybar and other helpers
+extern int WindowSnapshotShmID;
+extern EshyIPC::SnapshotWriter<EshyWMWindowSnapshot> WindowSnapshot;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*Fixed power of two buckets, bucket 0 counts zeros and bucket i counts values in [2^(i-1), 2^i). Recording is a handful of relaxed
+*  atomic adds and never allocates or locks, so it can sit in the frame path and be read from anywhere while frames keep coming.
+*  Percentiles are only as precise as the bucket they fall in. Independent of wlroots.*/
+class EshyWMHistogram
+{
+public:
+
+	static constexpr int BucketCount = 64;
+
+	EshyWMHistogram()
+		: Count(0)
+		, Sum(0)
+		, Max(0)
+	{
+		for (std::atomic<uint64_t>& Bucket : Buckets)
+			Bucket.store(0, std::memory_order_relaxed);
+	}
+
+	EshyWMHistogram(const EshyWMHistogram&) = delete;
+	EshyWMHistogram& operator=(const EshyWMHistogram&) = delete;
+
+	void Record(uint64_t Value)
+	{
+		Buckets[GetBucket(Value)].fetch_add(1, std::memory_order_relaxed);
+		Count.fetch_add(1, std::memory_order_relaxed);
+		Sum.fetch_add(Value, std::memory_order_relaxed);
+
+		uint64_t OldMax = Max.load(std::memory_order_relaxed);
+		while (Value > OldMax && !Max.compare_exchange_weak(OldMax, Value, std::memory_order_relaxed));
+	}
+
+	uint64_t GetCount() const {return Count.load(std::memory_order_relaxed);}
+	uint64_t GetSum() const {return Sum.load(std::memory_order_relaxed);}
+	uint64_t GetMax() const {return Max.load(std::memory_order_relaxed);}
+	uint64_t GetBucketCount(int Bucket) const {return Buckets[Bucket].load(std::memory_order_relaxed);}
+
+	//Largest value the bucket can hold
+	static uint64_t GetBucketLimit(int Bucket) {return Bucket == 0 ? 0 : Bucket >= BucketCount - 1 ? UINT64_MAX : (1ull << Bucket) - 1;}
+
+	//Upper limit of the bucket the given fraction of recorded values falls in, capped at the largest value recorded
+	uint64_t GetPercentile(double Fraction) const
+	{
+		const uint64_t Total = GetCount();
+		if (Total == 0)
+			return 0;
+
+		const uint64_t Rank = (uint64_t)(Fraction * (Total - 1)) + 1;
+		uint64_t Seen = 0;
+		for (int i = 0; i < BucketCount; ++i)
+		{
+			Seen += GetBucketCount(i);
+			if (Seen >= Rank)
+				return GetBucketLimit(i) < GetMax() ? GetBucketLimit(i) : GetMax();
+		}
+
+		return GetMax();
+	}
+
+private:
+
+	static int GetBucket(uint64_t Value)
+	{
+		const int Width = Value == 0 ? 0 : 64 - __builtin_clzll(Value);
+		return Width < BucketCount ? Width : BucketCount - 1;
+	}
+
+	std::atomic<uint64_t> Buckets[BucketCount];
+	std::atomic<uint64_t> Count;
+	std::atomic<uint64_t> Sum;
+	std::atomic<uint64_t> Max;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Server.h"
+
+#include <vector>
+#include <cstdint>
+
+#define HIT_GRID_CELL_SIZE 256
+
+/*Finds the window under the pointer without walking the whole scene graph. Each output has a uniform grid whose cells list the
+*  windows overlapping them, kept up to date as windows map, move, resize and unmap. A lookup only asks the scene about the few windows
+*  in the cursor's cell, topmost first. The surface that was hit last is remembered so motion inside it skips even that, as long as the
+*  cursor stays in the same cell and no window above it in that cell covers the point.
+*  Popups and the switcher overlay are not indexed, lookups go through the scene graph while either is around.*/
+class EshyWMHitTester
+{
+public:
+
+	EshyWMHitTester();
+
+	//Call after a window is mapped, moved or resized. Windows that are not mapped are dropped from the index
+	void UpdateWindow(class EshyWMWindowBase* Window);
+	void RemoveWindow(class EshyWMWindowBase* Window);
+	//Raising changes which window wins where windows overlap
+	void WindowRaised(class EshyWMWindowBase* Window);
+	//The window's surfaces may have changed size or input region, or gained subsurfaces
+	void WindowCommitted(class EshyWMWindowBase* Window);
+	//Rebuilds every grid, for when outputs are added, removed or moved
+	void RebuildOutputs();
+
+	void PopupCreated();
+	void PopupDestroyed();
+
+	//Drop-in replacement for DesktopWindowAt
+	class EshyWMWindowBase* WindowAt(double lx, double ly, struct wlr_surface** surface, double* sx, double* sy);
+
+	uint64_t GetHitTestsPerSecond() const;
+
+	uint64_t HitTests;
+	uint64_t CacheHits;
+	uint64_t SceneFallbacks;
+
+private:
+
+	struct OutputGrid
+	{
+		struct wlr_box Box;
+		int Columns;
+		int Rows;
+		std::vector<std::vector<class EshyWMWindowBase*>> Cells;
+	};
+
+	void Index(class EshyWMWindowBase* Window);
+	void Unindex(class EshyWMWindowBase* Window);
+	//Calls Fn with every cell, on every output, that Box overlaps
+	template<typename Function>
+	void ForEachCell(const struct wlr_box& Box, Function Fn);
+	OutputGrid* FindGrid(double lx, double ly);
+	//Index of the cell the point is in, the point must be inside the grid
+	static int GetCell(const OutputGrid& Grid, double lx, double ly);
+	void CountHitTest();
+
+	std::vector<OutputGrid> Grids;
+	size_t LastGrid;
+
+	//Scratch space for WindowAt so lookups do not allocate
+	std::vector<class EshyWMWindowBase*> Candidates;
+
+	//Bumped by anything that could change which surface is at a point
+	uint64_t Generation;
+	uint64_t StackCounter;
+	uint32_t PopupCount;
+
+	class EshyWMWindowBase* CachedWindow;
+	struct wlr_surface* CachedSurface;
+	int CachedX;
+	int CachedY;
+	uint64_t CachedGeneration;
+	//Where the cached surface was hit, a point in another cell may be covered by windows the cache never saw
+	size_t CachedGrid;
+	int CachedCell;
+
+	int64_t CurrentSecond;
+	uint64_t HitTestsThisSecond;
+	uint64_t HitTestsLastSecond;
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <wayland-server-core.h>
+
+#define ESHYWM_IPC_MAX_MESSAGE_SIZE			(64 * 1024)
+#define ESHYWM_IPC_MAX_OUTPUT_BUFFER_SIZE	(1024 * 1024)
+
+extern int IPCServerSocketReady(int fd, uint32_t mask, void* data);
+extern int IPCClientSocketReady(int fd, uint32_t mask, void* data);
+extern void IPCServerReapClients(void* data);
+
+class EshyWMIPCClient
+{
+public:
+
+	EshyWMIPCClient(int _Fd)
+		: Fd(_Fd)
+		, EventSource(nullptr)
+		, bSubscribed(false)
+		, bOverflowed(false)
+	{}
+
+	int Fd;
+	struct wl_event_source* EventSource;
+
+	//Partial request bytes waiting for the rest of their message and reply/event bytes the client has not read yet
+	std::string InputBuffer;
+	std::string OutputBuffer;
+
+	bool bSubscribed;
+	bool bOverflowed;
+};
+
+/*Control socket for scripts. Every message in both directions is a 32-bit native endian length followed by that many bytes of JSON.
+*  A request is either a single command object or an array of them, an array is executed as one batch before the next frame is rendered.*/
+class EshyWMIPCServer
+{
+public:
+
+	EshyWMIPCServer(struct wl_event_loop* _EventLoop);
+	~EshyWMIPCServer();
+
+	bool Start(const std::string& _SocketPath);
+
+	void AcceptClient();
+	void DisconnectClient(EshyWMIPCClient* Client);
+
+	bool ReadFromClient(EshyWMIPCClient* Client);
+	bool WriteToClient(EshyWMIPCClient* Client);
+	void QueueMessage(EshyWMIPCClient* Client, const std::string& Payload);
+
+	void BroadcastWindowEvent(const struct EshyWMMessage& Message);
+	void ReapOverflowedClients();
+
+	//Logs the same as get_frame_stats, for SIGUSR1
+	static void DumpFrameStats();
+
+	struct wl_event_loop* EventLoop;
+	struct wl_event_source* ListenSource;
+	int ListenFd;
+	std::string SocketPath;
+	bool bReapScheduled;
+
+	std::vector<EshyWMIPCClient*> Clients;
+};
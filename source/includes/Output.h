@@ -1,11 +1,27 @@
 
 #pragma once
 
+#include "Histogram.h"
+
 #include <wayland-server-core.h>
 
+#include <vector>
+#include <cstdint>
+
+#define static
+
+extern "C"
+{
+#include <wlr/util/box.h>
+}
+
+#undef static
+
 extern void OutputFrame(struct wl_listener* listener, void* data);
 extern void OutputRequestState(struct wl_listener* listener, void* data);
 extern void OutputDestroy(struct wl_listener* listener, void* data);
+extern void OutputPresent(struct wl_listener* listener, void* data);
+extern int OutputRenderTimer(void* data);
 
 class EshyWMOutput
 {
@@ -13,10 +29,82 @@ public:
 
 	EshyWMOutput(struct wlr_output* _WlrOutput)
 		: WlrOutput(_WlrOutput)
+		, ActiveWorkspace(nullptr)
+		, LayoutBox({0, 0, 0, 0})
+		, UsableArea({0, 0, 0, 0})
+		, bDirectScanout(false)
+		, DirectScanoutFrames(0)
+		, CompositedFrames(0)
+		, MaxRenderTime(0)
+		, RenderTimer(nullptr)
+		, bRenderScheduled(false)
+		, RenderTimeNs(0)
+		, PeakRenderTimeNs(0)
+		, LateFrames(0)
+		, FrameVblankNs(0)
+		, bFrameContinuous(false)
+		, bFrameCommitted(false)
+		, bCommitContinuous(false)
+		, LastPresentNs(0)
+		, LastPresentSeq(0)
+		, PresentRefreshNs(0)
+		, MissedVblankTotal(0)
 	{}
+	~EshyWMOutput();
 
 	struct wlr_output* WlrOutput;
 	struct wl_listener FrameListener;
 	struct wl_listener RequestStateListener;
 	struct wl_listener DestroyListener;
+	struct wl_listener PresentListener;
+
+	std::vector<class EshyWMWorkspace*> Workspaces;
+	class EshyWMWorkspace* ActiveWorkspace;
+
+	//Where the output is in the layout, and the part of it windows are laid out in. Kept current by Server->UpdateOutputAreas
+	struct wlr_box LayoutBox;
+	struct wlr_box UsableArea;
+
+	//Whether the last frame put a client buffer straight on the display instead of rendering the scene, and how often each happened
+	bool bDirectScanout;
+	uint64_t DirectScanoutFrames;
+	uint64_t CompositedFrames;
+
+	/*Milliseconds before the next vblank that rendering starts, so input that arrives meanwhile still makes it into the frame. 0 renders
+	*  right after the frame event, ESHYWM_MAX_RENDER_TIME_AUTO derives it from PeakRenderTimeNs*/
+	int MaxRenderTime;
+	struct wl_event_source* RenderTimer;
+	//RenderTimer is armed, frame events are ignored until it fires
+	bool bRenderScheduled;
+	//How long rendering and committing took last frame, and a slowly decaying peak of it
+	uint64_t RenderTimeNs;
+	uint64_t PeakRenderTimeNs;
+	//Frames whose rendering took longer than the budget they were scheduled with
+	uint64_t LateFrames;
+
+	//Milliseconds reserved for rendering before vblank, 0 when frames are not delayed
+	int GetRenderBudget() const;
+
+	/*Per frame timings in nanoseconds: from the vblank until the commit starts, which includes any render deadline wait, how long the
+	*  commit itself takes and the time between presented frames that were rendered back to back. Vblank and present times are the
+	*  backend's presentation timestamps. Queried with get_frame_stats, dumped on SIGUSR1*/
+	EshyWMHistogram FrameToCommitNs;
+	EshyWMHistogram CommitNs;
+	EshyWMHistogram FrameIntervalNs;
+	//Vblanks skipped between a commit and the next frame event, and output pixels redrawn per committed frame
+	EshyWMHistogram MissedVblanks;
+	EshyWMHistogram DamagedPixels;
+
+	//The vblank the current frame is counted from, the last present or the frame event after an idle period
+	uint64_t FrameVblankNs;
+	bool bFrameContinuous;
+	bool bFrameCommitted;
+	//The last commit was made for the frame event right after the previous present
+	bool bCommitContinuous;
+
+	uint64_t LastPresentNs;
+	uint64_t LastPresentSeq;
+	//Refresh period from the last present event, 0 when the backend did not know it
+	uint64_t PresentRefreshNs;
+	uint64_t MissedVblankTotal;
 };
\ No newline at end of file
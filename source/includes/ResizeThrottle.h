@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+
+//Where an interactive resize wants the window's geometry box, and which edges are being dragged
+struct EshyWMResizeRequest
+{
+	int X;
+	int Y;
+	int Width;
+	int Height;
+	uint32_t Edges;
+};
+
+/*Keeps at most one resize configure in flight per window. Sizes requested while the client is still drawing the previous one replace
+*  each other, and only the newest is sent once the client commits. A slow client then lags by one frame instead of by every motion
+*  event since the drag began. Independent of wlroots so the benchmark can drive it.*/
+class EshyWMResizeThrottle
+{
+public:
+
+	EshyWMResizeThrottle()
+		: Pending({0, 0, 0, 0, 0})
+		, InFlight({0, 0, 0, 0, 0})
+		, InFlightSerial(0)
+		, bPending(false)
+		, bInFlight(false)
+	{}
+
+	//Returns true when nothing is in flight and the caller should send TakePending() now
+	bool Queue(const EshyWMResizeRequest& Request)
+	{
+		Pending = Request;
+		bPending = true;
+		return !bInFlight;
+	}
+
+	const EshyWMResizeRequest& TakePending()
+	{
+		bPending = false;
+		InFlight = Pending;
+		return InFlight;
+	}
+
+	void Sent(uint32_t Serial)
+	{
+		bInFlight = true;
+		InFlightSerial = Serial;
+	}
+
+	//Call on every commit with the last configure serial the client acked. Returns true if that completes the in-flight configure
+	bool Committed(uint32_t AckedSerial)
+	{
+		if (!bInFlight || (int32_t)(AckedSerial - InFlightSerial) < 0)
+			return false;
+
+		bInFlight = false;
+		return true;
+	}
+
+	//For clients without configure serials, their first commit after a configure is taken as the answer to it
+	bool Committed() {return Committed(InFlightSerial);}
+
+	bool HasPending() const {return bPending;}
+	bool IsInFlight() const {return bInFlight;}
+	const EshyWMResizeRequest& GetInFlight() const {return InFlight;}
+
+	//Forgets everything, for when the window unmaps mid-resize
+	void Reset()
+	{
+		bPending = false;
+		bInFlight = false;
+	}
+
+private:
+
+	EshyWMResizeRequest Pending;
+	EshyWMResizeRequest InFlight;
+	uint32_t InFlightSerial;
+	bool bPending;
+	bool bInFlight;
+};
@@ -3,9 +3,12 @@
 
 #include <string>
 #include <vector>
+#include <cstdint>
 
 #include <wayland-server-core.h>
 
+#include "SlotMap.h"
+
 #define static
 
 extern "C"
@@ -24,10 +27,17 @@ enum EshyWMSceneLayer
 	L_Tile,
 	L_Float,
 	L_Top,
+	//Above everything on its output so the client's buffer can be scanned out directly, only X11 popups and the switcher go over it
+	L_Fullscreen,
+	//X11 menus and tooltips, they belong to whatever is under them and have to show over a fullscreen client too
+	L_Unmanaged,
 	L_Overlay,
 	L_NUM_LAYERS
 };
 
+//Eshybar runs along the bottom of the primary output
+#define ESHYBAR_HEIGHT 50
+
 enum EshyWMCursorMode
 {
 	ESHYWM_CURSOR_PASSTHROUGH,
@@ -35,7 +45,7 @@ enum EshyWMCursorMode
 	ESHYWM_CURSOR_RESIZE,
 };
 
-extern void SharedMemoryUpdated(const std::string& CurrentShm);
+extern void SharedMemoryUpdated(const struct EshyWMMessage& Message);
 
 class EshyWMServer
 {
@@ -49,6 +59,7 @@ public:
 	struct wlr_allocator* Allocator;
 	struct wlr_scene* Scene;
 	struct wlr_scene_output_layout* SceneLayout;
+	struct wlr_presentation* Presentation;
 	struct wlr_xwayland* XWayland;
 
 	struct wlr_xdg_shell* XdgShell;
@@ -56,7 +67,13 @@ public:
 	struct wl_listener NewXdgSurfaceListener;
 	struct wl_listener NewXWaylandSurfaceListener;
 	struct wl_listener XWaylandReadyListener;
-	std::vector<class EshyWMWindowBase*> WindowList;
+	//Owns every managed window. Window ids given to Eshybar and IPC clients are handles into it
+	EshyWMSlotMap<class EshyWMWindowBase> Windows;
+	//Iteration view over Windows, in no particular order
+	const std::vector<class EshyWMWindowBase*>& WindowList;
+	//Intrusive lists through EshyWMWindowBase::FocusLink and StackLink. Most recently focused first, topmost mapped window first
+	struct wl_list FocusOrder;
+	struct wl_list StackingOrder;
 
 	struct wlr_cursor* Cursor;
 	struct wlr_xcursor_manager* CursorMgr;
@@ -79,7 +96,8 @@ public:
 	struct wlr_box GrabGeobox;
 	uint32_t ResizeEdges;
 	bool bWindowModifierKeyPressed;
-	uint NextWindowIndex;
+	class EshyWMSwitcher* Switcher;
+	class EshyWMHitTester* HitTester;
 
 	struct wlr_scene_tree* Layers[L_NUM_LAYERS];
 
@@ -89,11 +107,88 @@ public:
 	std::vector<class EshyWMOutput*> OutputList;
 
 	class EshyWMSpecialWindow* Eshybar;
+	struct wl_event_source* EshybarMessageSource;
+	struct wl_event_source* FrameStatsSignalSource;
+
+	class EshyWMIPCServer* IPCServer;
+
+	//Windows whose title or app id changed since their last update was sent
+	std::vector<class EshyWMWindowBase*> MetadataDirtyWindows;
+	//Armed for the earliest window still inside metadata_update_interval
+	struct wl_event_source* MetadataTimer;
+	uint64_t MetadataUpdatesEmitted;
+	uint64_t MetadataUpdatesCoalesced;
+
+	//Move/resize motion waiting for the next output frame, and the time of the latest event folded into it
+	bool bGrabMotionPending;
+	uint32_t GrabMotionTime;
+	uint64_t GrabMotionEvents;
+	uint64_t GrabMotionApplied;
+
+	//Interactive resize configures sent to clients and drawn by them, across all windows
+	uint64_t ResizeConfiguresSent;
+	uint64_t ResizeConfiguresCommitted;
 
     void BeginEventLoop();
     void Shutdown();
 
 	void CloseWindow(EshyWMWindowBase* window);
 
+	//Takes ownership of a new window and puts it at the back of the focus order
+	void AddWindow(class EshyWMWindowBase* Window);
+	//Unlinks and frees the window
+	void RemoveWindow(class EshyWMWindowBase* Window);
+	//Moves the window to the top of its scene layer and of StackingOrder
+	void RaiseWindow(class EshyWMWindowBase* Window);
+
+	//Splits the focused tiled window's tile on Window's workspace for it, or the last tiled one's. Call before focusing Window
+	void TileWindow(class EshyWMWindowBase* Window);
+	void UntileWindow(class EshyWMWindowBase* Window);
+
+	//Focuses the most recently focused window that can be seen on Workspace, or nothing if there is none
+	void FocusMostRecent(class EshyWMWorkspace* Workspace);
+	void ClearFocus();
+
+	//The active workspace of the output under the cursor, where new windows go. Null while there are no outputs
+	class EshyWMWorkspace* GetCurrentWorkspace();
+	//Scene tree windows on Workspace are parented to, or the layer itself for windows without a workspace
+	struct wlr_scene_tree* GetWindowLayer(class EshyWMWorkspace* Workspace, bool bTiled);
+	struct wlr_scene_tree* GetFullscreenLayer(class EshyWMWorkspace* Workspace);
+	//Shows Workspace on its output in place of the one shown before, keyboard focus is left alone
+	void ShowWorkspace(class EshyWMWorkspace* Workspace);
+	//Shows the output's workspace at Index and focuses what was last focused on it
+	void SwitchWorkspace(class EshyWMOutput* Output, int Index);
+	//Null takes the window out of every workspace, it then shows on all of them
+	void MoveWindowToWorkspace(class EshyWMWindowBase* Window, class EshyWMWorkspace* Workspace);
+	//Hands the output's windows to the first remaining output and frees it
+	void RemoveOutput(class EshyWMOutput* Output);
+
+	/*Output lookups, null only while there are no outputs. Points off every output resolve to the nearest one. A window's output is
+	*  cached in EshyWMWindowBase::Output and refreshed whenever the window moves*/
+	class EshyWMOutput* GetOutputAt(double lx, double ly);
+	class EshyWMOutput* GetCursorOutput();
+	class EshyWMOutput* GetWindowOutput(class EshyWMWindowBase* Window);
+	//The output Eshybar is on
+	class EshyWMOutput* GetPrimaryOutput();
+	//Refreshes every output's layout box and usable area and lays the workspaces out again, after outputs change
+	void UpdateOutputAreas();
+
+	//Tells Eshybar and every subscribed IPC client about a window change
+	void NotifyWindowEvent(const struct EshyWMMessage& Message);
+
+	/*Title and app id changes are not sent straight away. The window is marked and at most one update per window goes out per output
+	*  frame, carrying whatever the latest values are by then. Windows held back by the rate limit are sent by MetadataTimer*/
+	void QueueMetadataUpdate(class EshyWMWindowBase* Window);
+	void FlushMetadataUpdates();
+	void CancelMetadataUpdate(class EshyWMWindowBase* Window);
+
+	/*Motion during an interactive move/resize. With ESHYWM_COALESCE_GRAB_MOTION the window is only moved or resized on the next
+	*  output frame, using wherever the cursor is by then*/
+	void QueueGrabMotion(uint32_t Time);
+	void FlushGrabMotion();
+
     void ResetCursorMode();
+
+	//Runs a shell command and waits for it like system(), but without the signal mask the event loop needs for SIGUSR1
+	void RunCommand(const std::string& Command);
 };
\ No newline at end of file
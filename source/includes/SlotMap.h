@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*Owns heap objects and hands out 64-bit handles for them, the slot index in the low half and the slot's generation in the high half.
+*  A slot's generation is odd while it holds an object and even while it is free, so a stale handle fails Get in O(1) instead of
+*  pointing at freed memory. Objects are kept densely packed for iteration, removal moves the last one into the hole.*/
+template<class T>
+class EshyWMSlotMap
+{
+public:
+
+	typedef uint64_t Handle;
+	static constexpr Handle InvalidHandle = 0;
+
+	EshyWMSlotMap()
+		: FreeHead(NoSlot)
+	{}
+
+	~EshyWMSlotMap()
+	{
+		for (T* Value : Dense)
+			delete Value;
+	}
+
+	EshyWMSlotMap(const EshyWMSlotMap&) = delete;
+	EshyWMSlotMap& operator=(const EshyWMSlotMap&) = delete;
+
+	//Takes ownership of Value
+	Handle Insert(T* Value)
+	{
+		uint32_t Index;
+		if (FreeHead != NoSlot)
+		{
+			Index = FreeHead;
+			FreeHead = Slots[Index].DenseIndex;
+			Slots[Index].Generation++;
+		}
+		else
+		{
+			Index = (uint32_t)Slots.size();
+			Slots.push_back({1, 0});
+		}
+
+		Slots[Index].DenseIndex = (uint32_t)Dense.size();
+		Dense.push_back(Value);
+		DenseSlots.push_back(Index);
+		return MakeHandle(Index, Slots[Index].Generation);
+	}
+
+	//Returns nullptr for handles that were never issued or whose object was removed
+	T* Get(Handle h) const
+	{
+		const uint32_t Index = (uint32_t)h;
+		if (Index >= Slots.size() || !(Slots[Index].Generation & 1) || Slots[Index].Generation != (uint32_t)(h >> 32))
+			return nullptr;
+
+		return Dense[Slots[Index].DenseIndex];
+	}
+
+	bool Contains(Handle h) const {return Get(h);}
+
+	//Deletes the object and invalidates every copy of its handle
+	void Remove(Handle h)
+	{
+		if (!Get(h))
+			return;
+
+		const uint32_t Index = (uint32_t)h;
+		const uint32_t DenseIndex = Slots[Index].DenseIndex;
+		delete Dense[DenseIndex];
+
+		//Fill the hole with the last object
+		const uint32_t Last = (uint32_t)Dense.size() - 1;
+		Dense[DenseIndex] = Dense[Last];
+		DenseSlots[DenseIndex] = DenseSlots[Last];
+		Slots[DenseSlots[DenseIndex]].DenseIndex = DenseIndex;
+		Dense.pop_back();
+		DenseSlots.pop_back();
+
+		//Live generations are odd so InvalidHandle can never match a live slot
+		Slot& Removed = Slots[Index];
+		Removed.Generation++;
+		Removed.DenseIndex = FreeHead;
+		FreeHead = Index;
+	}
+
+	size_t Size() const {return Dense.size();}
+	bool Empty() const {return Dense.empty();}
+
+	//Every live object, packed. Invalidated by Insert and Remove
+	const std::vector<T*>& Values() const {return Dense;}
+
+private:
+
+	static constexpr uint32_t NoSlot = UINT32_MAX;
+
+	//DenseIndex is the object's position in Dense while the slot is live and the next free slot while it is not
+	struct Slot
+	{
+		uint32_t Generation;
+		uint32_t DenseIndex;
+	};
+
+	static Handle MakeHandle(uint32_t Index, uint32_t Generation)
+	{
+		return ((Handle)Generation << 32) | Index;
+	}
+
+	std::vector<Slot> Slots;
+	std::vector<T*> Dense;
+	std::vector<uint32_t> DenseSlots;
+	uint32_t FreeHead;
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+
+/*Alt+Tab switcher. Cycles through the mapped, managed windows on shown workspaces in Server->FocusOrder one step at a time, previewing
+*  the candidate by raising it, and shows an overlay in Layers[L_Overlay] with a tile per window in focus order. Each step is O(1), only
+*  opening the switcher walks the focus order and touches every tile.*/
+class EshyWMSwitcher
+{
+public:
+
+	EshyWMSwitcher(struct wlr_scene_tree* _Parent);
+
+	bool IsActive() const {return Selected;}
+
+	//Opens the switcher on the first step
+	void Next();
+	void Previous();
+
+	//Focuses the selected window, or raises the window that was on top before switching
+	void Commit();
+	void Cancel();
+
+	//Must be called once the window can no longer be switched to, after it was unmapped or left FocusOrder, and before it is freed
+	void WindowRemoved(class EshyWMWindowBase* Window);
+
+private:
+
+	bool Open();
+	void Close();
+	void BuildOverlay();
+	void Select(int Step);
+
+	struct wlr_scene_tree* Parent;
+	struct wlr_scene_tree* Tree;
+	struct wlr_scene_rect* Highlight;
+	int TileCount;
+
+	//Switchable windows in focus order as of opening
+	std::vector<class EshyWMWindowBase*> Candidates;
+	class EshyWMWindowBase* Selected;
+	class EshyWMWindowBase* OriginalTopWindow;
+	//Selected's index in Candidates, only tiles below TileCount are on screen
+	size_t SelectedPosition;
+};
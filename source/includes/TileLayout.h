@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+struct EshyWMTileRect
+{
+	int X;
+	int Y;
+	int Width;
+	int Height;
+
+	bool operator==(const EshyWMTileRect& Other) const {return X == Other.X && Y == Other.Y && Width == Other.Width && Height == Other.Height;}
+	bool operator!=(const EshyWMTileRect& Other) const {return !(*this == Other);}
+};
+
+enum EshyWMTileSplit
+{
+	TS_Horizontal,	//Children side by side
+	TS_Vertical		//Children stacked
+};
+
+//Leaves hold a client, splits divide their rect between two children at Ratio
+struct EshyWMTileNode
+{
+	EshyWMTileNode* Parent;
+	EshyWMTileNode* Children[2];
+	EshyWMTileSplit Split;
+	float Ratio;
+	EshyWMTileRect Rect;
+	void* Client;
+
+	bool IsLeaf() const {return !Children[0];}
+};
+
+/*Binary split tree tiling layout. A new client splits the target leaf's tile in two along its longer side. Every change only lays out
+*  the subtree it touches: inserting lays out the new split, removing lays out the sibling that takes over the space, moving a divider
+*  lays out that split. Only SetArea lays out the whole tree. Place is called for each client whose tile actually changed.
+*  Does not depend on wlroots so it can be benchmarked on its own.*/
+class EshyWMTileLayout
+{
+public:
+
+	typedef void (*PlaceFunction)(void* Client, const EshyWMTileRect& Rect);
+
+	explicit EshyWMTileLayout(PlaceFunction _Place);
+	~EshyWMTileLayout();
+
+	EshyWMTileLayout(const EshyWMTileLayout&) = delete;
+	EshyWMTileLayout& operator=(const EshyWMTileLayout&) = delete;
+
+	void SetArea(const EshyWMTileRect& _Area);
+
+	//Splits Target's tile, or the last inserted leaf's when Target is null. Returns the client's new leaf
+	EshyWMTileNode* Insert(void* Client, EshyWMTileNode* Target);
+	void Remove(EshyWMTileNode* Leaf);
+
+	//Moves the divider between Leaf and its sibling to the given layout coordinates
+	void MoveDivider(EshyWMTileNode* Leaf, int X, int Y);
+	void SetRatio(EshyWMTileNode* Split, float Ratio);
+
+	size_t GetLeafCount() const {return LeafCount;}
+	//Nodes laid out so far, for measuring how much each change touches
+	uint64_t GetNodesLaidOut() const {return NodesLaidOut;}
+
+private:
+
+	//Lays out Node in Rect. Unchanged splits are skipped unless bForce, their children cannot have moved
+	void Layout(EshyWMTileNode* Node, const EshyWMTileRect& Rect, bool bForce);
+	void Replace(EshyWMTileNode* Old, EshyWMTileNode* New);
+	static void DestroyTree(EshyWMTileNode* Node);
+
+	PlaceFunction Place;
+	EshyWMTileNode* Root;
+	EshyWMTileNode* LastLeaf;
+	size_t LeafCount;
+	EshyWMTileRect Area;
+	uint64_t NodesLaidOut;
+};
@@ -3,6 +3,7 @@
 
 #include "Server.h"
 #include "Shared.h"
+#include "ResizeThrottle.h"
 
 enum EshyWMWindowType
 {
@@ -12,28 +13,49 @@ enum EshyWMWindowType
 	WT_X11Unmanaged
 };
 
-enum BORDER_SIDE
-{
-	BS_TOP 		= 0,
-	BS_BOTTOM 	= 1,
-	BS_LEFT 	= 2,
-	BS_RIGHT 	= 3
-};
-
 extern EshyWMWindowBase* DesktopWindowAt(double lx, double ly, struct wlr_surface** surface, double* sx, double* sy);
+//Resolves a node returned by wlr_scene_node_at to the window owning it, as DesktopWindowAt does
+extern EshyWMWindowBase* WindowFromNode(struct wlr_scene_node* node, struct wlr_surface** surface);
 
 class EshyWMWindowBase
 {
 public:
 
 	EshyWMWindowBase()
-		: WindowState(ESHYWM_WINDOW_STATE_NORMAL)
+		: Handle(EshyWMSlotMap<EshyWMWindowBase>::InvalidHandle)
+		, Scene(nullptr)
+		, Decoration(nullptr)
+		, WindowState(ESHYWM_WINDOW_STATE_NORMAL)
+		, PreMinimizeState(ESHYWM_WINDOW_STATE_NORMAL)
+		, bPreMinimizeTiled(false)
 		, SavedGeo({0, 0, 0, 0})
-	{}
+		, bMetadataDirty(false)
+		, LastMetadataUpdateTime(0)
+		, HitBox({0, 0, 0, 0})
+		, bHitIndexed(false)
+		, HitLayer(0)
+		, StackSerial(0)
+		, TileNode(nullptr)
+		, Workspace(nullptr)
+		, Output(nullptr)
+	{
+		wl_list_init(&FocusLink);
+		wl_list_init(&StackLink);
+	}
+
+	virtual ~EshyWMWindowBase() {}
+
+	//This window's handle in Server->Windows, what clients know it by
+	uint64_t Handle;
+
+	//Links in Server->FocusOrder and Server->StackingOrder, the latter only while the window is mapped
+	struct wl_list FocusLink;
+	struct wl_list StackLink;
 
 	struct wlr_scene_tree* Scene;
 	struct wlr_scene_tree* SceneTree;
-	struct wlr_scene_rect* Border[4];
+	//Null while the window has no border, e.g. when fullscreen
+	class EshyWMDecoration* Decoration;
 	
 	struct wl_listener MapListener;
 	struct wl_listener UnmapListener;
@@ -45,11 +67,42 @@ public:
 	struct wl_listener SetTitleListener;
 
 	EEshyWMWindowState WindowState;
+	//What minimizing replaced, given back when the window is restored
+	EEshyWMWindowState PreMinimizeState;
+	bool bPreMinimizeTiled;
 	wlr_box SavedGeo;
 	wlr_box WindowGeometry;
 
 	EshyWMWindowType WindowType;
 
+	//Title/app id change waiting in Server->MetadataDirtyWindows, and when the last one was sent in CLOCK_MONOTONIC milliseconds
+	bool bMetadataDirty;
+	uint64_t LastMetadataUpdateTime;
+
+	//Layout box this window occupies in Server->HitTester, its scene layer and how recently it was raised
+	wlr_box HitBox;
+	bool bHitIndexed;
+	int HitLayer;
+	uint64_t StackSerial;
+
+	//Interactive resize configures, at most one waiting for the client to draw it
+	EshyWMResizeThrottle ResizeThrottle;
+
+	//Leaf in its workspace's TileLayout, null while floating or minimized
+	struct EshyWMTileNode* TileNode;
+	//Null for windows that show on every workspace, like X override-redirect windows
+	class EshyWMWorkspace* Workspace;
+	//Output the window's center is on, see UpdateOutput
+	class EshyWMOutput* Output;
+
+	virtual struct wlr_surface* GetSurface() const {return nullptr;}
+	//Toplevels are tracked from creation, only mapped ones have a scene node and can be acted on
+	bool IsMapped() const;
+	virtual const char* GetAppID() const {return "NO_APP_CLASS";}
+	virtual const char* GetTitle() const {return "NO_TITLE";}
+	EshyWMMessage MakeWindowMessage(EEshyWMAction Action) const;
+	EshyWMWindowRecord MakeWindowRecord() const;
+
     virtual void FocusWindow();
 	virtual void UnfocusWindow();
 
@@ -57,13 +110,29 @@ public:
     virtual void ProcessCursorMove(uint32_t time) {}
     virtual void ProcessCursorResize(uint32_t time) {}
 
+	//Moves the scene node and keeps the hit-test index and Output in step
+	void SetPosition(int x, int y);
+	/*Refreshes Output, usually without a lookup as most moves stay on the same output. A window dragged onto another output joins
+	*  the workspace shown there*/
+	void UpdateOutput();
+
+	//Sends the size now if the client is idle, otherwise once it commits the one it is drawing
+	void RequestResize(const EshyWMResizeRequest& Request);
+	//Call from the commit handler once ResizeThrottle says the in-flight configure is on screen
+	void FinishResize();
+	void SendPendingResize();
+	virtual uint32_t SendResizeConfigure(const EshyWMResizeRequest& Request) {return 0;}
+	//Places the window and its border around the size the client actually committed
+	virtual void ApplyResize(const EshyWMResizeRequest& Request) {}
+
 	void CreateBorder();
 	void DestroyBorder();
 	void UpdateBorder();
 
 	virtual void UpdateWindowGeometry() {}
 
-	virtual void MinimizeWindow(bool b_minimize) {}
+	//Hides the window by disabling its scene node, the client is left mapped
+	void MinimizeWindow(bool b_minimize);
 	virtual void MaximizeWindow(bool b_maximize) {}
 	virtual void FullscreenWindow(bool b_fullscreen) {}
 	void ToggleMinimize() {MinimizeWindow(!(WindowState == ESHYWM_WINDOW_STATE_MINIMIZED));}
@@ -80,6 +149,11 @@ public:
 	struct wlr_xdg_toplevel* XdgToplevel;
 
 	struct wl_listener SetAppIdListener;
+	struct wl_listener CommitListener;
+
+	virtual struct wlr_surface* GetSurface() const override;
+	virtual const char* GetAppID() const override;
+	virtual const char* GetTitle() const override;
 
     virtual void FocusWindow() override;
 	virtual void UnfocusWindow() override;
@@ -90,7 +164,9 @@ public:
 	virtual void ProcessCursorMove(uint32_t time) override;
     virtual void ProcessCursorResize(uint32_t time) override;
 
-	virtual void MinimizeWindow(bool b_minimize) override;
+	virtual uint32_t SendResizeConfigure(const EshyWMResizeRequest& Request) override;
+	virtual void ApplyResize(const EshyWMResizeRequest& Request) override;
+
 	virtual void MaximizeWindow(bool b_maximize) override;
 	virtual void FullscreenWindow(bool b_fullscreen) override;
 };
@@ -109,6 +185,11 @@ public:
 	struct wl_listener XActivateListener;
 	struct wl_listener XConfigureListener;
 	struct wl_listener XSetHintsListener;
+	struct wl_listener XSetClassListener;
+
+	virtual struct wlr_surface* GetSurface() const override;
+	virtual const char* GetAppID() const override;
+	virtual const char* GetTitle() const override;
 
 	virtual void FocusWindow() override;
 	virtual void UnfocusWindow() override;
@@ -118,4 +199,7 @@ public:
 	virtual void BeginInteractive(enum EshyWMCursorMode mode, uint32_t edges) override;
 	virtual void ProcessCursorMove(uint32_t time) override;
     virtual void ProcessCursorResize(uint32_t time) override;
+
+	virtual uint32_t SendResizeConfigure(const EshyWMResizeRequest& Request) override;
+	virtual void ApplyResize(const EshyWMResizeRequest& Request) override;
 };
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#define ESHYWM_WORKSPACE_COUNT 9
+
+/*One of an output's workspaces. Its windows live in scene trees of its own under the tile, float and fullscreen layers. Only the
+*  output's active workspace has its trees enabled, the scene skips disabled trees entirely so windows on hidden workspaces are not
+*  drawn, get no frame callbacks and cannot be hit, while their clients stay mapped. Switching only flips set_enabled on those trees.*/
+class EshyWMWorkspace
+{
+public:
+
+	EshyWMWorkspace(class EshyWMOutput* _Output, int _Index);
+	~EshyWMWorkspace();
+
+	EshyWMWorkspace(const EshyWMWorkspace&) = delete;
+	EshyWMWorkspace& operator=(const EshyWMWorkspace&) = delete;
+
+	class EshyWMOutput* Output;
+	int Index;
+
+	struct wlr_scene_tree* TileTree;
+	struct wlr_scene_tree* FloatTree;
+	struct wlr_scene_tree* FullscreenTree;
+	//Tiled windows on this workspace, laid out over the output
+	class EshyWMTileLayout* TileLayout;
+
+	bool IsActive() const {return bActive;}
+	void SetActive(bool _bActive);
+	bool HasFullscreenWindow() const;
+	//Dialogs opened over a fullscreen window share its layer, once no mapped fullscreen window is left they go back to floating
+	void ReleaseTransients();
+
+	//Puts a tiled window back in its tile, e.g. when it leaves fullscreen
+	void PlaceTiled(class EshyWMWindowBase* Window);
+
+private:
+
+	bool bActive;
+};
@@ -8,11 +8,13 @@
 #include "EshyIPC.h"
 #include "Shared.h"
 
-#include <nlohmann/json.hpp>
-
+#include <stdio.h>
 #include <iostream>
 #include <map>
 #include <fstream>
+#include <thread>
+#include <vector>
+#include <algorithm>
 
 static float StartingLocationX = 5.0f;
 static float StartingLocationY = 5.0f;
@@ -35,6 +37,7 @@ struct EshyWMWindowRef
 		, Image(_Image)
 		, WindowState(ESHYWM_WINDOW_STATE_NORMAL)
 		, bWindowFocused(false)
+		, bFromEvents(false)
 	{}
 
 	euiSolidEntity* Background;
@@ -42,19 +45,30 @@ struct EshyWMWindowRef
 
 	EEshyWMWindowState WindowState;
 	bool bWindowFocused;
+	//Added from the event broadcast because the snapshot had no room for it, the snapshot takes over if it shows up there later
+	bool bFromEvents;
 
 	uint64_t WindowID;
+	int Index;
+	std::string AppID;
 };
 
 static std::map<uint64_t, EshyWMWindowRef*> EWMWindows;
 
-static void SendDataToCompositor(const char* Action, uint64_t Data)
+static EshyIPC::Channel<EshyWMMessage> SendChannel;
+static EshyIPC::Channel<EshyWMMessage> ReceiveChannel;
+
+//Window events the compositor publishes to every bar and tool
+static int EventsShmID = -1;
+static EshyIPC::BroadcastChannel<EshyWMMessage> Events;
+
+//Window list published by the compositor, only ring messages are used for windows when it is not available
+static int SnapshotShmID = -1;
+static EshyIPC::SnapshotReader<EshyWMWindowSnapshot> WindowSnapshot;
+
+static void SendDataToCompositor(EEshyWMAction Action, uint64_t Data)
 {
-	nlohmann::json SendInfo;
-	SendInfo["action"] = Action;
-	SendInfo["sender_client"] = CLIENT_ESHYBAR;
-	SendInfo["window_id"] = Data;
-	EshyIPC::InsertIntoMemoryUnprotected(SHMID, SendInfo.dump());
+	SendChannel.Send(MakeMessage(Action, CLIENT_ESHYBAR, Data));
 }
 
 static void NotifyPointerEnter(euiEntity* Entity, void* Data)
@@ -121,10 +135,47 @@ static EshyWMWindowRef* AddIcon(int Index, const std::string& ImagePath, uint64_
 
 	EshyWMWindowRef* WindowRef = new EshyWMWindowRef(Background, Image);
 	WindowRef->WindowID = WindowID;
+	WindowRef->Index = Index;
 	Background->CallbackData = (void*)(uint64_t)WindowRef;
 	return WindowRef;
 }
 
+static void DestroyIcon(EshyWMWindowRef* WindowRef)
+{
+	delete WindowRef->Background;
+	delete WindowRef->Image;
+	delete WindowRef;
+}
+
+//Moves the icons left to fill the gaps removed ones left, keeping their order
+static void ReindexIcons()
+{
+	std::vector<EshyWMWindowRef*> Refs;
+	for (auto [key, WindowRef] : EWMWindows)
+		Refs.push_back(WindowRef);
+
+	std::sort(Refs.begin(), Refs.end(), [](const EshyWMWindowRef* A, const EshyWMWindowRef* B) {return A->Index < B->Index;});
+
+	for (int i = 0; i < (int)Refs.size(); ++i)
+	{
+		const float x = StartingLocationX + (BackgroundWidth * i) + (Padding * i);
+		Refs[i]->Index = i;
+		Refs[i]->Background->SetPosition(x, StartingLocationY);
+		Refs[i]->Image->SetPosition(x + (InternalPadding / 2), StartingLocationY + (InternalPadding / 2.0f));
+	}
+}
+
+static void RemoveIcon(uint64_t WindowID)
+{
+	auto it = EWMWindows.find(WindowID);
+	if(it == EWMWindows.end())
+		return;
+
+	DestroyIcon(it->second);
+	EWMWindows.erase(it);
+	ReindexIcons();
+}
+
 
 static void MouseButtonCallback(GLFWwindow* Window, int Button, int Action, int Mods)
 {
@@ -155,31 +206,104 @@ static std::string RetrieveIconFilePath(const std::string& AppId)
 	return "/usr/share/icons/hicolor/256x256/apps/" + IconName + ".png";
 }
 
-static void SharedMemoryChanged(const std::string& CurrentShm)
+static void SyncWindowSnapshot();
+
+static void SharedMemoryChanged(const EshyWMMessage& Message)
 {
-	nlohmann::json Data = nlohmann::json::parse(CurrentShm);
-	if (Data["sender_client"] == CLIENT_COMPOSITOR)
+	if (Message.SenderClient != CLIENT_COMPOSITOR)
+		return;
+
+	switch (Message.Action)
 	{
-		if (Data["action"] == ACTION_ADD_WINDOW)
+	case ACTION_ADD_WINDOW:
+	{
+		//The snapshot is updated before the event goes out, a window missing from it did not fit
+		if(WindowSnapshot.IsOpen())
+			SyncWindowSnapshot();
+
+		if(EWMWindows.find(Message.WindowID) != EWMWindows.end())
+			break;
+
+		//Make icons for any new windows
+		EshyWMWindowRef* WindowRef = AddIcon((int)EWMWindows.size(), RetrieveIconFilePath(Message.AppID), Message.WindowID);
+		WindowRef->bFromEvents = WindowSnapshot.IsOpen();
+		EWMWindows.emplace(Message.WindowID, WindowRef);
+		break;
+	}
+	case ACTION_REMOVE_WINDOW:
+	{
+		//Remove icons for any removed window, the snapshot removes its own
+		auto it = EWMWindows.find(Message.WindowID);
+		if(it != EWMWindows.end() && (!WindowSnapshot.IsOpen() || it->second->bFromEvents))
+			RemoveIcon(Message.WindowID);
+		break;
+	}
+	case ACTION_CONFIGURE_ESHYBAR:
+		renderer->UpdateWindowSize((float)Message.Width, 50.0f);
+		break;
+	default:
+		break;
+	}
+}
+
+static void SyncWindowSnapshot()
+{
+	if(!WindowSnapshot.IsOpen() || !WindowSnapshot.HasChanges())
+		return;
+
+	WindowSnapshot.Sync(
+		[]()
 		{
-			//Make icons for any new windows
-			EshyWMWindowRef* WindowRef = AddIcon((int)EWMWindows.size(), RetrieveIconFilePath(Data["app_id"]), Data["window_id"]);
-			auto result = EWMWindows.emplace(Data["window_id"], WindowRef);
-		}
-		else if (Data["action"] == ACTION_REMOVE_WINDOW)
+			//Windows the snapshot could not hold are not replayed, keep them
+			for(auto it = EWMWindows.begin(); it != EWMWindows.end();)
+				if(it->second->bFromEvents)
+					++it;
+				else
+				{
+					DestroyIcon(it->second);
+					it = EWMWindows.erase(it);
+				}
+
+			ReindexIcons();
+		},
+		[](const EshyWMWindowRecord& Record)
 		{
-			//Remove icons for any removed window
-			EWMWindows.erase(Data["window_id"]);
-		}
-		else if (Data["action"] == ACTION_CONFIGURE_ESHYBAR)
+			auto it = EWMWindows.find(Record.ID);
+			if(it == EWMWindows.end())
+			{
+				it = EWMWindows.emplace(Record.ID, AddIcon((int)EWMWindows.size(), RetrieveIconFilePath(Record.AppID), Record.ID)).first;
+				it->second->AppID = Record.AppID;
+			}
+			else if(it->second->AppID != Record.AppID)
+			{
+				//Clients often set their app id after the window was created, switch to the matching icon
+				EshyWMWindowRef* WindowRef = it->second;
+				const float x = StartingLocationX + (BackgroundWidth * WindowRef->Index) + (Padding * WindowRef->Index) + (InternalPadding / 2);
+				delete WindowRef->Image;
+				WindowRef->Image = new euiImageEntity(x, StartingLocationY + (InternalPadding / 2.0f), ImageWidth, ImageHeight, EUI_ANCHOR_LEFT_BOTTOM, renderer, RetrieveIconFilePath(Record.AppID));
+				WindowRef->AppID = Record.AppID;
+			}
+
+			it->second->WindowState = Record.State;
+			it->second->bWindowFocused = Record.bFocused;
+			it->second->bFromEvents = false;
+		},
+		[](const EshyWMWindowRecord& Record)
 		{
-			renderer->UpdateWindowSize((float)Data["width"], 50.0f);
-		}
-	}
+			RemoveIcon(Record.ID);
+		});
 }
 
 int main(int argc, char* argv[])
 {
+	//Window add, remove and update events only arrive through the event broadcast, without its token the bar would silently stay empty
+	if(argc < 8)
+	{
+		fprintf(stderr, "Usage: %s SHM_TOKEN WIDTH HEIGHT CLIENT_NOTIFIER COMPOSITOR_NOTIFIER SNAPSHOT_TOKEN EVENTS_TOKEN\n", argv[0]);
+		fprintf(stderr, "eshybar is started by the compositor, which passes these\n");
+		return 1;
+	}
+
 	const int ScreenWidth = atoi(argv[2]);
 	const int ScreenHeight = atoi(argv[3]);
 
@@ -188,12 +312,79 @@ int main(int argc, char* argv[])
 
 	glfwSetMouseButtonCallback(window, MouseButtonCallback);
 
-	SHMID = atoi(argv[1]);
-	eipcSharedMemory SharedMemory;
-	std::string CurrentShm;
+	SHMID = EshyIPC::OpenSharedMemoryToken(argv[1]);
+	if(SHMID < 0 || !EshyIPC::AttachSharedMemoryBlock(SHMID).Block)
+	{
+		fprintf(stderr, "eshybar: cannot map the compositor's shared memory block %s\n", argv[1]);
+		return 1;
+	}
+
+	SendChannel.Open(SHMID, EIPC_TO_COMPOSITOR);
+	ReceiveChannel.Open(SHMID, EIPC_TO_CLIENT);
+	EshyWMMessage CurrentMessage;
+
+	//Sleep until there is input or a message instead of polling every frame
+	const int ClientNotifier = atoi(argv[4]);
+	EshyIPC::SetNotifier(SHMID, EIPC_TO_CLIENT, ClientNotifier);
+	EshyIPC::SetNotifier(SHMID, EIPC_TO_COMPOSITOR, atoi(argv[5]));
+
+	std::thread([ClientNotifier]()
+	{
+		while(true)
+			if(EshyIPC::WaitForNotifier(ClientNotifier, -1))
+				glfwPostEmptyEvent();
+	}).detach();
+
+	//Start from the compositor's current window list instead of having it replay every window to us
+	SnapshotShmID = EshyIPC::OpenSharedMemoryToken(argv[6]);
+	if(SnapshotShmID < 0 || !WindowSnapshot.Open(SnapshotShmID))
+	{
+		fprintf(stderr, "eshybar: cannot map the window snapshot %s\n", argv[6]);
+		SnapshotShmID = -1;
+	}
+
+	EventsShmID = EshyIPC::OpenSharedMemoryToken(argv[7]);
+	if(EventsShmID < 0 || !EshyIPC::AttachSharedMemoryBlock(EventsShmID).Block)
+	{
+		fprintf(stderr, "eshybar: cannot map the event broadcast %s\n", argv[7]);
+		return 1;
+	}
+
+	Events.Open(EventsShmID);
+
+	std::thread([]()
+	{
+		//Private cursor, the main loop drains its own after being woken
+		EshyIPC::BroadcastChannel<EshyWMMessage> WakeEvents;
+		WakeEvents.Open(EventsShmID);
+
+		EshyWMMessage Event;
+		while(true)
+		{
+			if(WakeEvents.Wait(-1))
+				glfwPostEmptyEvent();
+
+			while(WakeEvents.Receive(Event) != EIPC_RECEIVE_EMPTY);
+		}
+	}).detach();
 
     while (!glfwWindowShouldClose(window))
     {
+		//Handle every message the compositor sent since the last frame, in order
+		if(ReceiveChannel.HasNewMessages())
+			while(ReceiveChannel.Receive(CurrentMessage))
+				SharedMemoryChanged(CurrentMessage);
+
+		//Missed events mean the incremental view can no longer be trusted
+		eipcReceiveResult Result;
+		while((Result = Events.Receive(CurrentMessage)) != EIPC_RECEIVE_EMPTY)
+			if(Result == EIPC_RECEIVE_OVERRUN)
+				WindowSnapshot.Invalidate();
+			else
+				SharedMemoryChanged(CurrentMessage);
+
+		SyncWindowSnapshot();
+
 		renderer->Clear();
 		renderer->SetBackgroundColor(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
 
@@ -209,18 +400,19 @@ int main(int argc, char* argv[])
 			Icon->Image->Draw(*renderer);
 		}
 
-		//Only runs when shared memory changes
-		SharedMemory = EshyIPC::AttachSharedMemoryBlock(SHMID);
-		if(CurrentShm != SharedMemory.Block)
-		{
-			CurrentShm = SharedMemory.Block;
-			SharedMemoryChanged(CurrentShm);
-		}
+		//The compositor fires our notifier once it made room in a full ring, which wakes this loop to retry
+		SendChannel.Flush();
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
+
+		glfwWaitEvents();
     }
 
+	WindowSnapshot.Close();
+
+	EshyIPC::DetachSharedMemoryBlock(EventsShmID);
+
+	EshyIPC::DetachSharedMemoryBlock(SHMID);
 	Shutdown();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,227 @@
+#include "TileLayout.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <algorithm>
+
+/*Checks EshyWMTileLayout invariants on trees split at random places: after every Insert, Remove, MoveDivider and SetArea the leaf tiles
+*  cover the area exactly with no gaps or overlap, divider ratios stay clamped, and only clients inside the touched subtree are placed.
+*  Exits non-zero on the first failure.*/
+
+#define TEST_MIN_RATIO 0.05f
+#define TEST_MAX_RATIO 0.95f
+
+#define CHECK(Condition) \
+    do { if (!(Condition)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #Condition); exit(1); } } while (0)
+
+//Latest tile handed to each client, and which clients were placed since the last reset
+static std::map<void*, EshyWMTileRect> ClientRects;
+static std::set<void*> Placed;
+
+static void RecordPlacement(void* Client, const EshyWMTileRect& Rect)
+{
+    ClientRects[Client] = Rect;
+    Placed.insert(Client);
+}
+
+//Deterministic so failures can be reproduced
+static uint64_t NextRandom(uint64_t& State)
+{
+    State = State * 6364136223846793005ull + 1442695040888963407ull;
+    return State >> 33;
+}
+
+static long long Intersection(const EshyWMTileRect& A, const EshyWMTileRect& B)
+{
+    const long long Width = std::min(A.X + A.Width, B.X + B.Width) - std::max(A.X, B.X);
+    const long long Height = std::min(A.Y + A.Height, B.Y + B.Height) - std::max(A.Y, B.Y);
+    return Width > 0 && Height > 0 ? Width * Height : 0;
+}
+
+static bool IsInside(const EshyWMTileNode* Node, const EshyWMTileNode* Subtree)
+{
+    for (; Node; Node = Node->Parent)
+    {
+        if (Node == Subtree)
+            return true;
+    }
+    return false;
+}
+
+static size_t CountNodes(const EshyWMTileNode* Node)
+{
+    return Node->IsLeaf() ? 1 : 1 + CountNodes(Node->Children[0]) + CountNodes(Node->Children[1]);
+}
+
+//Each leaf's tile matches what its client was last given, and together they tile Area exactly
+static void CheckTiling(const EshyWMTileLayout& Layout, const std::vector<EshyWMTileNode*>& Leaves, const EshyWMTileRect& Area)
+{
+    CHECK(Layout.GetLeafCount() == Leaves.size());
+    CHECK(ClientRects.size() == Leaves.size());
+
+    long long Covered = 0;
+    for (size_t i = 0; i < Leaves.size(); ++i)
+    {
+        const EshyWMTileRect& Rect = Leaves[i]->Rect;
+        CHECK(ClientRects.count(Leaves[i]->Client) && ClientRects[Leaves[i]->Client] == Rect);
+        CHECK(Rect.Width >= 0 && Rect.Height >= 0);
+        CHECK(Rect.X >= Area.X && Rect.Y >= Area.Y);
+        CHECK(Rect.X + Rect.Width <= Area.X + Area.Width && Rect.Y + Rect.Height <= Area.Y + Area.Height);
+        Covered += (long long)Rect.Width * Rect.Height;
+
+        for (size_t j = i + 1; j < Leaves.size(); ++j)
+            CHECK(Intersection(Rect, Leaves[j]->Rect) == 0);
+    }
+
+    //Inside the area and not overlapping, so equal area means no gaps. An empty layout covers nothing
+    CHECK(Covered == (Leaves.empty() ? 0 : (long long)Area.Width * Area.Height));
+}
+
+static void CheckRatios(const EshyWMTileNode* Node)
+{
+    for (; Node && Node->Parent; Node = Node->Parent)
+        CHECK(Node->Parent->Ratio >= TEST_MIN_RATIO && Node->Parent->Ratio <= TEST_MAX_RATIO);
+}
+
+static void* ClientID(uintptr_t ID)
+{
+    return (void*)ID;
+}
+
+static void TestRandomOperations(uint64_t Seed)
+{
+    EshyWMTileRect Area = {0, 0, 1920, 1080};
+    EshyWMTileLayout Layout(RecordPlacement);
+    Layout.SetArea(Area);
+    ClientRects.clear();
+
+    std::vector<EshyWMTileNode*> Leaves;
+    uintptr_t NextClient = 1;
+    uint64_t State = Seed;
+
+    for (int Step = 0; Step < 2000; ++Step)
+    {
+        const uint64_t Operation = Leaves.size() < 2 ? 0 : NextRandom(State) % 4;
+        Placed.clear();
+
+        if (Operation == 0 && Leaves.size() < 48)
+        {
+            //Splitting Target only gives Target and the new client tiles
+            EshyWMTileNode* Target = Leaves.empty() ? nullptr : Leaves[NextRandom(State) % Leaves.size()];
+            void* TargetClient = Target ? Target->Client : nullptr;
+            EshyWMTileNode* Leaf = Layout.Insert(ClientID(NextClient++), Target);
+            Leaves.push_back(Leaf);
+
+            CHECK(Leaf->IsLeaf() && (!Target || Leaf->Parent == Target->Parent));
+            for (void* Client : Placed)
+                CHECK(Client == Leaf->Client || Client == TargetClient);
+        }
+        else if (Operation == 1 || Operation == 0)
+        {
+            //Only clients under the sibling that takes over the space move
+            const size_t Index = NextRandom(State) % Leaves.size();
+            EshyWMTileNode* Leaf = Leaves[Index];
+            EshyWMTileNode* Split = Leaf->Parent;
+            EshyWMTileNode* Sibling = Split->Children[0] == Leaf ? Split->Children[1] : Split->Children[0];
+
+            ClientRects.erase(Leaf->Client);
+            Leaves.erase(Leaves.begin() + Index);
+            Layout.Remove(Leaf);
+
+            for (void* Client : Placed)
+            {
+                const auto Found = std::find_if(Leaves.begin(), Leaves.end(), [Client](EshyWMTileNode* Node) {return Node->Client == Client;});
+                CHECK(Found != Leaves.end() && IsInside(*Found, Sibling));
+            }
+        }
+        else if (Operation == 2)
+        {
+            //Dragging anywhere, even past the split's tile, keeps the ratio clamped and only moves that split's clients
+            EshyWMTileNode* Leaf = Leaves[NextRandom(State) % Leaves.size()];
+            EshyWMTileNode* Split = Leaf->Parent;
+            const int X = Split->Rect.X - Split->Rect.Width / 2 + (int)(NextRandom(State) % (uint64_t)(Split->Rect.Width * 2 + 1));
+            const int Y = Split->Rect.Y - Split->Rect.Height / 2 + (int)(NextRandom(State) % (uint64_t)(Split->Rect.Height * 2 + 1));
+            const uint64_t NodesBefore = Layout.GetNodesLaidOut();
+
+            Layout.MoveDivider(Leaf, X, Y);
+
+            CHECK(Layout.GetNodesLaidOut() - NodesBefore <= CountNodes(Split));
+            for (void* Client : Placed)
+            {
+                const auto Found = std::find_if(Leaves.begin(), Leaves.end(), [Client](EshyWMTileNode* Node) {return Node->Client == Client;});
+                CHECK(Found != Leaves.end() && IsInside(*Found, Split));
+            }
+        }
+        else
+        {
+            Area.Width = 200 + (int)(NextRandom(State) % 3000);
+            Area.Height = 200 + (int)(NextRandom(State) % 2000);
+            Layout.SetArea(Area);
+        }
+
+        CheckTiling(Layout, Leaves, Area);
+        for (EshyWMTileNode* Leaf : Leaves)
+            CheckRatios(Leaf);
+    }
+
+    while (!Leaves.empty())
+    {
+        ClientRects.erase(Leaves.back()->Client);
+        Layout.Remove(Leaves.back());
+        Leaves.pop_back();
+        CheckTiling(Layout, Leaves, Area);
+    }
+}
+
+static void TestRatioClamping()
+{
+    const EshyWMTileRect Area = {100, 50, 1000, 800};
+    EshyWMTileLayout Layout(RecordPlacement);
+    Layout.SetArea(Area);
+    ClientRects.clear();
+
+    EshyWMTileNode* First = Layout.Insert(ClientID(1), nullptr);
+    EshyWMTileNode* Second = Layout.Insert(ClientID(2), First);
+    EshyWMTileNode* Split = Second->Parent;
+    CHECK(Split && Split->Split == TS_Horizontal && Split->Ratio == 0.5f);
+
+    Layout.MoveDivider(Second, Area.X - 5000, 0);
+    CHECK(Split->Ratio == TEST_MIN_RATIO);
+    Layout.MoveDivider(Second, Area.X + Area.Width + 5000, 0);
+    CHECK(Split->Ratio == TEST_MAX_RATIO);
+    Layout.SetRatio(Split, -1.0f);
+    CHECK(Split->Ratio == TEST_MIN_RATIO);
+    Layout.SetRatio(Split, 2.0f);
+    CHECK(Split->Ratio == TEST_MAX_RATIO);
+    CheckTiling(Layout, {First, Second}, Area);
+
+    //A divider move that clamps to the current ratio lays nothing out
+    Placed.clear();
+    const uint64_t NodesBefore = Layout.GetNodesLaidOut();
+    Layout.MoveDivider(Second, Area.X + Area.Width + 10, 0);
+    CHECK(Layout.GetNodesLaidOut() == NodesBefore && Placed.empty());
+
+    //Nor does an area change that keeps the area
+    Layout.SetArea(Area);
+    CHECK(Placed.empty());
+
+    Layout.Remove(Second);
+    ClientRects.erase(ClientID(2));
+    CHECK(First->Parent == nullptr);
+    CheckTiling(Layout, {First}, Area);
+}
+
+int main()
+{
+    TestRatioClamping();
+
+    for (uint64_t Seed = 1; Seed <= 20; ++Seed)
+        TestRandomOperations(Seed);
+
+    printf("TileLayoutTest passed\n");
+    return 0;
+}